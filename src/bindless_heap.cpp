@@ -0,0 +1,160 @@
+#include "bindless_heap.hpp"
+
+#include <array>
+#include <stdexcept>
+
+#include "buffer_impl.hpp"
+#include "graphics_device.hpp"
+
+// Must match the bindings in `bindless.h.hlsl`.
+const uint32_t kParameterBinding = 0;
+const uint32_t kSamplerBinding = 1;
+const uint32_t kTextureBinding = 2;
+const vk::ShaderStageFlags kMaterialStages =
+    vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment;
+
+BindlessHeap BindlessHeap::create(const GraphicsDevice &device) {
+  auto vkDevice = device.vkDevice();
+
+  auto poolSizes = std::to_array<vk::DescriptorPoolSize>({
+      {vk::DescriptorType::eStorageBuffer, 1},
+      {vk::DescriptorType::eSampler, 1},
+      {vk::DescriptorType::eSampledImage, kMaxTextures},
+  });
+  auto descriptorPool = vkDevice.createDescriptorPoolUnique(
+      vk::DescriptorPoolCreateInfo{}
+          .setFlags(vk::DescriptorPoolCreateFlagBits::eUpdateAfterBind)
+          .setMaxSets(1)
+          .setPoolSizes(poolSizes));
+
+  auto sampler = vkDevice.createSamplerUnique(
+      vk::SamplerCreateInfo{}
+          .setMagFilter(vk::Filter::eLinear)
+          .setMinFilter(vk::Filter::eLinear)
+          .setMipmapMode(vk::SamplerMipmapMode::eLinear)
+          .setAddressModeU(vk::SamplerAddressMode::eRepeat)
+          .setAddressModeV(vk::SamplerAddressMode::eRepeat)
+          .setAddressModeW(vk::SamplerAddressMode::eRepeat)
+          .setMaxLod(vk::LodClampNone));
+  auto immutableSampler = sampler.get();
+
+  auto setBindings = std::to_array({
+      vk::DescriptorSetLayoutBinding{kParameterBinding,
+                                     vk::DescriptorType::eStorageBuffer, 1,
+                                     kMaterialStages},
+      vk::DescriptorSetLayoutBinding{kSamplerBinding,
+                                     vk::DescriptorType::eSampler, 1,
+                                     kMaterialStages, &immutableSampler},
+      vk::DescriptorSetLayoutBinding{kTextureBinding,
+                                     vk::DescriptorType::eSampledImage,
+                                     kMaxTextures, kMaterialStages},
+  });
+  // Textures are added while the set is in use, and slots past the last one
+  // added are never written.
+  auto bindingFlags = std::to_array<vk::DescriptorBindingFlags>({
+      vk::DescriptorBindingFlagBits::eUpdateAfterBind,
+      {},
+      vk::DescriptorBindingFlagBits::eUpdateAfterBind |
+          vk::DescriptorBindingFlagBits::ePartiallyBound,
+  });
+  auto bindingFlagsInfo =
+      vk::DescriptorSetLayoutBindingFlagsCreateInfo{}.setBindingFlags(
+          bindingFlags);
+  auto setLayout = vkDevice.createDescriptorSetLayoutUnique(
+      vk::DescriptorSetLayoutCreateInfo{}
+          .setPNext(&bindingFlagsInfo)
+          .setFlags(
+              vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPool)
+          .setBindings(setBindings));
+  // Dynamic buffers can't be updated after bind, so they get a set of their
+  // own.
+  auto frameUniformBinding = vk::DescriptorSetLayoutBinding{
+      0, vk::DescriptorType::eUniformBufferDynamic, 1, kMaterialStages};
+  auto frameUniformSetLayout = vkDevice.createDescriptorSetLayoutUnique(
+      vk::DescriptorSetLayoutCreateInfo{}.setBindings(frameUniformBinding));
+  auto setLayouts =
+      std::to_array({setLayout.get(), frameUniformSetLayout.get()});
+  auto pushConstantRanges = std::to_array(
+      {vk::PushConstantRange{kMaterialStages, 0, kPushConstantSize}});
+  auto pipelineLayout = vkDevice.createPipelineLayoutUnique(
+      vk::PipelineLayoutCreateInfo{}
+          .setSetLayouts(setLayouts)
+          .setPushConstantRanges(pushConstantRanges));
+
+  auto descriptorSet = vkDevice.allocateDescriptorSets(
+      vk::DescriptorSetAllocateInfo{}
+          .setSetLayouts(setLayout.get())
+          .setDescriptorPool(descriptorPool.get()))[0];
+
+  auto parameterBuffer = Buffer::create(
+      device, vk::BufferUsageFlagBits::eStorageBuffer,
+      vma::MemoryUsage::eGpuOnly, kMaxMaterials * sizeof(MaterialParameters));
+  parameterBuffer.uploadRange(device, std::array<MaterialParameters, 1>{},
+                              kDefaultMaterial * sizeof(MaterialParameters));
+  auto parameterBufferInfo = vk::DescriptorBufferInfo{}
+                                 .setBuffer(parameterBuffer.vkBuffer())
+                                 .setRange(vk::WholeSize);
+  vkDevice.updateDescriptorSets(
+      vk::WriteDescriptorSet{}
+          .setDstSet(descriptorSet)
+          .setDstBinding(kParameterBinding)
+          .setDescriptorCount(1)
+          .setDescriptorType(vk::DescriptorType::eStorageBuffer)
+          .setBufferInfo(parameterBufferInfo),
+      {});
+
+  return {std::move(descriptorPool),
+          std::move(sampler),
+          std::move(setLayout),
+          std::move(frameUniformSetLayout),
+          std::move(pipelineLayout),
+          descriptorSet,
+          std::move(parameterBuffer)};
+}
+
+void BindlessHeap::bind(vk::CommandBuffer cmd) const {
+  cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics,
+                         _vkPipelineLayout.get(), kHeapSet, _descriptorSet,
+                         {});
+}
+
+MaterialIndex BindlessHeap::addMaterial(const GraphicsDevice &device,
+                                        const MaterialParameters &parameters) {
+  if (_materialCount == kMaxMaterials) {
+    throw std::runtime_error("bindless heap is out of material slots");
+  }
+  auto index = _materialCount++;
+  setMaterial(device, index, parameters);
+  return index;
+}
+
+void BindlessHeap::setMaterial(const GraphicsDevice &device,
+                               MaterialIndex index,
+                               const MaterialParameters &parameters) {
+  _parameterBuffer.uploadRange(device, std::array{parameters},
+                               index * sizeof(MaterialParameters));
+  // Frames in flight may still read the slot's previous parameters.
+  device.uploads().waitForFrames();
+}
+
+TextureIndex BindlessHeap::addTexture(const GraphicsDevice &device,
+                                      vk::ImageView imageView) {
+  if (_textureCount == kMaxTextures) {
+    throw std::runtime_error("bindless heap is out of texture slots");
+  }
+  auto index = _textureCount++;
+  auto imageInfo =
+      vk::DescriptorImageInfo{}
+          .setImageView(imageView)
+          .setImageLayout(vk::ImageLayout::eShaderReadOnlyOptimal);
+  device.vkDevice().updateDescriptorSets(
+      vk::WriteDescriptorSet{}
+          .setDstSet(_descriptorSet)
+          .setDstBinding(kTextureBinding)
+          .setDstArrayElement(index)
+          .setDescriptorCount(1)
+          .setDescriptorType(vk::DescriptorType::eSampledImage)
+          .setImageInfo(imageInfo),
+      {});
+  return index;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include <vulkan/vulkan.hpp>
+
+#include <glm/glm.hpp>
+
+#include "buffer.hpp"
+
+using MaterialIndex = uint32_t;
+using TextureIndex = uint32_t;
+
+// Record of the heap's material parameter buffer. Must match
+// `MaterialParameters` in `bindless.h.hlsl`.
+struct MaterialParameters {
+  glm::vec4 color;
+  // Slots in the heap's texture array.
+  std::array<TextureIndex, 4> textures;
+};
+static_assert(sizeof(MaterialParameters) == 32);
+
+struct GraphicsDevice;
+// Single descriptor set shared by every material: a storage buffer holding the
+// parameters of all materials, followed by a large array of sampled images.
+// Both are update-after-bind, so the set is bound once per command buffer and
+// stays valid while materials and textures are added. Materials are then
+// referred to by index, and draws only differing in their material can share a
+// pipeline.
+//
+// Every material pipeline must be created with `vkPipelineLayout`, which also
+// holds the push constant range, so that binding a pipeline never disturbs the
+// set. The layout's second set, `kFrameUniformSet`, is a dynamic uniform
+// buffer for data written every frame, bound by the `FrameAllocator`.
+struct BindlessHeap {
+  const static uint32_t kMaxMaterials = 4096;
+  const static uint32_t kMaxTextures = 4096;
+  // Minimum size guaranteed by every device.
+  const static uint32_t kPushConstantSize = 128;
+  // Zeroed parameters, used by materials without any.
+  const static MaterialIndex kDefaultMaterial = 0;
+  const static uint32_t kHeapSet = 0;
+  const static uint32_t kFrameUniformSet = 1;
+
+  BindlessHeap(vk::UniqueDescriptorPool vkDescriptorPool,
+               vk::UniqueSampler vkSampler,
+               vk::UniqueDescriptorSetLayout vkSetLayout,
+               vk::UniqueDescriptorSetLayout vkFrameUniformSetLayout,
+               vk::UniquePipelineLayout vkPipelineLayout,
+               vk::DescriptorSet descriptorSet, Buffer parameterBuffer)
+      : _vkDescriptorPool(std::move(vkDescriptorPool)),
+        _vkSampler(std::move(vkSampler)),
+        _vkSetLayout(std::move(vkSetLayout)),
+        _vkFrameUniformSetLayout(std::move(vkFrameUniformSetLayout)),
+        _vkPipelineLayout(std::move(vkPipelineLayout)),
+        _descriptorSet(descriptorSet),
+        _parameterBuffer(std::move(parameterBuffer)) {}
+
+  static BindlessHeap create(const GraphicsDevice &device);
+
+  inline vk::PipelineLayout vkPipelineLayout() const {
+    return _vkPipelineLayout.get();
+  }
+  inline vk::DescriptorSet vkDescriptorSet() const { return _descriptorSet; }
+  inline vk::DescriptorSetLayout vkFrameUniformSetLayout() const {
+    return _vkFrameUniformSetLayout.get();
+  }
+
+  // Binds the heap for graphics pipelines recorded into `cmd`.
+  void bind(vk::CommandBuffer cmd) const;
+
+  // Slots are never released. Materials being recreated should keep their
+  // slot and `setMaterial` it instead.
+  MaterialIndex addMaterial(const GraphicsDevice &device,
+                            const MaterialParameters &parameters);
+  void setMaterial(const GraphicsDevice &device, MaterialIndex index,
+                   const MaterialParameters &parameters);
+  // `imageView` must be in shader read-only layout whenever it is sampled.
+  TextureIndex addTexture(const GraphicsDevice &device,
+                          vk::ImageView imageView);
+
+private:
+  vk::UniqueDescriptorPool _vkDescriptorPool;
+  vk::UniqueSampler _vkSampler;
+  vk::UniqueDescriptorSetLayout _vkSetLayout;
+  vk::UniqueDescriptorSetLayout _vkFrameUniformSetLayout;
+  vk::UniquePipelineLayout _vkPipelineLayout;
+  vk::DescriptorSet _descriptorSet;
+  Buffer _parameterBuffer;
+  MaterialIndex _materialCount = kDefaultMaterial + 1;
+  TextureIndex _textureCount = 0;
+};
@@ -4,10 +4,36 @@
 
 Buffer Buffer::create(const GraphicsDevice &device, vk::BufferUsageFlags usage,
                       vma::MemoryUsage memoryUsage, size_t size) {
+  // Shared with the upload queue's family, so uploads can write into buffers
+  // frames are reading without ownership transfers.
+  auto queueFamilies = device.bufferQueueFamilies();
+  auto sharingMode = queueFamilies.size() == 1 ? vk::SharingMode::eExclusive
+                                               : vk::SharingMode::eConcurrent;
   auto raw = device.vmaAllocator().createBufferUnique(
       vk::BufferCreateInfo{}
           .setUsage(usage | vk::BufferUsageFlagBits::eTransferDst)
-          .setSize(size),
+          .setSize(size)
+          .setSharingMode(sharingMode)
+          .setQueueFamilyIndices(queueFamilies),
       vma::AllocationCreateInfo{}.setUsage(memoryUsage));
   return {std::move(raw.first), std::move(raw.second)};
 }
+
+Buffer Buffer::createMapped(const GraphicsDevice &device,
+                            vk::BufferUsageFlags usage, size_t size) {
+  return createMapped(device.vmaAllocator(), usage, size);
+}
+
+Buffer Buffer::createMapped(vma::Allocator allocator,
+                            vk::BufferUsageFlags usage, size_t size) {
+  vma::AllocationInfo allocationInfo;
+  auto raw = allocator.createBufferUnique(
+      vk::BufferCreateInfo{}.setUsage(usage).setSize(size),
+      vma::AllocationCreateInfo{}
+          .setFlags(vma::AllocationCreateFlagBits::eMapped)
+          .setUsage(vma::MemoryUsage::eCpuToGpu)
+          .setRequiredFlags(vk::MemoryPropertyFlagBits::eHostCoherent),
+      &allocationInfo);
+  return {std::move(raw.first), std::move(raw.second),
+          allocationInfo.pMappedData};
+}
@@ -1,16 +1,28 @@
 #pragma once
 
+#include <cstddef>
+
 #include <vk_mem_alloc.hpp>
 #include <vulkan/vulkan.hpp>
 
+#include "upload_token.hpp"
+
 struct GraphicsDevice;
 struct Buffer {
-  Buffer(vma::UniqueBuffer vkBuffer, vma::UniqueAllocation vmaAllocation)
+  Buffer(vma::UniqueBuffer vkBuffer, vma::UniqueAllocation vmaAllocation,
+         void *mappedData = nullptr)
       : _vkBuffer(std::move(vkBuffer)),
-        _vmaAllocation(std::move(vmaAllocation)) {}
+        _vmaAllocation(std::move(vmaAllocation)), _mappedData(mappedData) {}
 
   static Buffer create(const GraphicsDevice &device, vk::BufferUsageFlags usage,
                        vma::MemoryUsage memoryUsage, size_t size);
+  // Host-visible buffer mapped for its whole lifetime, see `mappedData`.
+  static Buffer createMapped(const GraphicsDevice &device,
+                             vk::BufferUsageFlags usage, size_t size);
+  static Buffer createMapped(vma::Allocator allocator,
+                             vk::BufferUsageFlags usage, size_t size);
+  // GPU-only buffers filled through the device's upload batch, see
+  // `uploadToken`.
   template <std::ranges::range TRange>
   static Buffer createGPUOnlyArray(const GraphicsDevice &device,
                                    const TRange &range,
@@ -20,12 +32,28 @@ struct Buffer {
                               vk::BufferUsageFlags usage);
 
   inline vk::Buffer vkBuffer() const { return _vkBuffer.get(); };
+  // Null unless created with `createMapped`. The memory is host-coherent, so
+  // writes need no flush.
+  inline std::byte *mappedData() const {
+    return static_cast<std::byte *>(_mappedData);
+  }
+  // Token of the uploads into this buffer so far, done once its contents are
+  // on the GPU.
+  inline UploadToken uploadToken() const { return _uploadToken; }
 
   template <std::ranges::range TRange>
   void copyRangeInto(const GraphicsDevice &device, const TRange &range);
+  // Copies `range` into this (GPU-only) buffer at `offset` through the
+  // device's staging ring. Returns once the copy is recorded into the
+  // device's upload batch, not submitted, with a token to wait for it.
+  template <std::ranges::range TRange>
+  UploadToken uploadRange(const GraphicsDevice &device, const TRange &range,
+                          vk::DeviceSize offset);
   template <class T> void copyInto(const GraphicsDevice &device, const T &src);
 
 private:
   vma::UniqueBuffer _vkBuffer;
   vma::UniqueAllocation _vmaAllocation;
+  void *_mappedData;
+  UploadToken _uploadToken;
 };
@@ -1,15 +1,19 @@
+#pragma once
+
 #include "buffer.hpp"
 
 #include <cstring>
 #include <ranges>
 
+#include "cpu_profiler.hpp"
 #include "graphics_device.hpp"
-#include "graphics_device_impl.hpp"
+#include "upload_queue.hpp"
 
 template <std::ranges::range TRange>
 Buffer Buffer::createGPUOnlyArray(const GraphicsDevice &device,
                                   const TRange &range,
                                   vk::BufferUsageFlags usage) {
+  CPU_ZONE("create GPU-only array");
   using TItem = std::ranges::range_value_t<TRange>;
 
   const size_t size = sizeof(TItem) * std::ranges::size(range);
@@ -17,15 +21,7 @@ Buffer Buffer::createGPUOnlyArray(const GraphicsDevice &device,
   auto finalBuffer =
       Buffer::create(device, usage | vk::BufferUsageFlagBits::eTransferDst,
                      vma::MemoryUsage::eGpuOnly, size);
-  auto stagingBuffer =
-      Buffer::create(device, vk::BufferUsageFlagBits::eTransferSrc,
-                     vma::MemoryUsage::eCpuToGpu, size);
-  stagingBuffer.copyRangeInto(device, range);
-
-  device.runOneTimeWork([&](vk::CommandBuffer cmd) {
-    cmd.copyBuffer(stagingBuffer.vkBuffer(), finalBuffer.vkBuffer(),
-                   vk::BufferCopy{}.setSize(size));
-  });
+  finalBuffer.uploadRange(device, range, 0);
 
   return finalBuffer;
 }
@@ -38,19 +34,39 @@ Buffer Buffer::createGPUOnly(const GraphicsDevice &device, const T &src,
   auto finalBuffer =
       Buffer::create(device, usage | vk::BufferUsageFlagBits::eTransferDst,
                      vma::MemoryUsage::eGpuOnly, size);
-  auto stagingBuffer =
-      Buffer::create(device, vk::BufferUsageFlagBits::eTransferSrc,
-                     vma::MemoryUsage::eCpuToGpu, size);
-  stagingBuffer.copyInto(device, src);
-
-  device.runOneTimeWork([&](vk::CommandBuffer cmd) {
-    cmd.copyBuffer(stagingBuffer.vkBuffer(), finalBuffer.vkBuffer(),
-                   vk::BufferCopy{}.setSize(size));
-  });
+  auto staging = device.uploads().stage(size);
+  std::memcpy(staging.data, &src, size);
+
+  finalBuffer._uploadToken =
+      device.uploads().record([&](vk::CommandBuffer cmd) {
+        cmd.copyBuffer(
+            staging.buffer, finalBuffer.vkBuffer(),
+            vk::BufferCopy{}.setSrcOffset(staging.offset).setSize(size));
+      });
 
   return finalBuffer;
 }
 
+template <std::ranges::range TRange>
+UploadToken Buffer::uploadRange(const GraphicsDevice &device,
+                                const TRange &range, vk::DeviceSize offset) {
+  using TItem = std::ranges::range_value_t<TRange>;
+
+  const size_t size = sizeof(TItem) * std::ranges::size(range);
+
+  auto staging = device.uploads().stage(size);
+  std::ranges::copy(range, reinterpret_cast<TItem *>(staging.data));
+
+  _uploadToken = device.uploads().record([&](vk::CommandBuffer cmd) {
+    cmd.copyBuffer(staging.buffer, vkBuffer(),
+                   vk::BufferCopy{}
+                       .setSrcOffset(staging.offset)
+                       .setDstOffset(offset)
+                       .setSize(size));
+  });
+  return _uploadToken;
+}
+
 template <std::ranges::range TRange>
 void Buffer::copyRangeInto(const GraphicsDevice &device, const TRange &src) {
   using TItem = std::ranges::range_value_t<TRange>;
@@ -0,0 +1,214 @@
+#include "cpu_profiler.hpp"
+
+#include <array>
+#include <format>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+enum class EventKind : uint8_t { eZone, eCounter, eFrameMark };
+
+struct Event {
+  const char *name;
+  EventKind kind;
+  // Nanoseconds on `CpuProfiler::Clock`. Frame marks and counters only have
+  // a begin.
+  int64_t begin;
+  int64_t end;
+  double value;
+};
+
+// Events are appended to fixed-size chunks that are never moved or freed, so
+// the exporting thread can read them while the owning thread appends: each
+// event is published by the release store of the chunk's count.
+struct Chunk {
+  static constexpr size_t kCapacity = 4096;
+
+  std::array<Event, kCapacity> events;
+  std::atomic<size_t> count = 0;
+  std::atomic<Chunk *> next = nullptr;
+};
+
+struct ThreadBuffer {
+  explicit ThreadBuffer(uint32_t id) : id(id), tail(&head) {}
+  ThreadBuffer(const ThreadBuffer &) = delete;
+  ThreadBuffer &operator=(const ThreadBuffer &) = delete;
+  ~ThreadBuffer() {
+    for (auto *chunk = head.next.load(); chunk;) {
+      auto *next = chunk->next.load();
+      delete chunk;
+      chunk = next;
+    }
+  }
+
+  // Only called from the owning thread.
+  void append(const Event &event) {
+    auto count = tail->count.load(std::memory_order_relaxed);
+    if (count == Chunk::kCapacity) {
+      auto *chunk = new Chunk;
+      tail->next.store(chunk, std::memory_order_release);
+      tail = chunk;
+      count = 0;
+    }
+    tail->events[count] = event;
+    tail->count.store(count + 1, std::memory_order_release);
+  }
+
+  uint32_t id;
+  // Guarded by the registry's mutex
+  std::string name;
+  Chunk head;
+  Chunk *tail;
+};
+
+// Buffers of every thread that recorded anything. They outlive their
+// threads, so the trace keeps the events of finished threads.
+struct Registry {
+  std::mutex mutex;
+  std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+  CpuProfiler::Clock::time_point origin = CpuProfiler::Clock::now();
+};
+
+Registry &registry() {
+  static Registry registry;
+  return registry;
+}
+
+ThreadBuffer &threadBuffer() {
+  thread_local ThreadBuffer *buffer = [] {
+    auto &registry = ::registry();
+    std::scoped_lock lock{registry.mutex};
+    auto id = static_cast<uint32_t>(registry.buffers.size());
+    registry.buffers.push_back(std::make_unique<ThreadBuffer>(id));
+    return registry.buffers.back().get();
+  }();
+  return *buffer;
+}
+
+int64_t nanosecondsOf(CpuProfiler::Clock::time_point time) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             time.time_since_epoch())
+      .count();
+}
+
+// Names are expected to be plain identifiers, but are escaped anyway.
+std::string escapeJson(std::string_view text) {
+  std::string escaped;
+  for (auto c : text) {
+    if (c == '"' || c == '\\') {
+      escaped += '\\';
+    }
+    escaped += static_cast<unsigned char>(c) < 0x20 ? ' ' : c;
+  }
+  return escaped;
+}
+
+} // namespace
+
+void CpuProfiler::start() {
+  // Registered before recording, so the origin precedes every event.
+  registry();
+  _recording.store(true, std::memory_order_relaxed);
+}
+
+void CpuProfiler::stop() { _recording.store(false, std::memory_order_relaxed); }
+
+void CpuProfiler::zone(const char *name, Clock::time_point begin,
+                       Clock::time_point end) {
+  threadBuffer().append({name, EventKind::eZone, nanosecondsOf(begin),
+                         nanosecondsOf(end), 0.0});
+}
+
+void CpuProfiler::counter(const char *name, double value) {
+  if (!recording()) {
+    return;
+  }
+  auto now = nanosecondsOf(Clock::now());
+  threadBuffer().append({name, EventKind::eCounter, now, now, value});
+}
+
+void CpuProfiler::frameMark() {
+  if (!recording()) {
+    return;
+  }
+  auto now = nanosecondsOf(Clock::now());
+  threadBuffer().append({"frame", EventKind::eFrameMark, now, now, 0.0});
+}
+
+void CpuProfiler::nameThread(std::string name) {
+  auto &buffer = threadBuffer();
+  auto &registry = ::registry();
+  std::scoped_lock lock{registry.mutex};
+  buffer.name = std::move(name);
+}
+
+void CpuProfiler::writeChromeTrace(const std::string &path) {
+  std::ofstream file(path, std::ios::trunc);
+  if (!file) {
+    throw std::runtime_error(std::format("failed to open trace {}", path));
+  }
+  auto &registry = ::registry();
+  std::scoped_lock lock{registry.mutex};
+  auto origin = nanosecondsOf(registry.origin);
+  // Microseconds since the profiler was first used, as Chrome expects.
+  auto timestamp = [&](int64_t time) {
+    return static_cast<double>(time - origin) / 1000.0;
+  };
+
+  file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  bool first = true;
+  auto separator = [&] {
+    auto result = first ? "\n" : ",\n";
+    first = false;
+    return result;
+  };
+  for (const auto &buffer : registry.buffers) {
+    if (!buffer->name.empty()) {
+      file << separator()
+           << std::format("{{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,"
+                          "\"tid\":{},\"args\":{{\"name\":\"{}\"}}}}",
+                          buffer->id, escapeJson(buffer->name));
+    }
+    for (const Chunk *chunk = &buffer->head; chunk;
+         chunk = chunk->next.load(std::memory_order_acquire)) {
+      auto count = chunk->count.load(std::memory_order_acquire);
+      for (size_t i = 0; i < count; i++) {
+        const auto &event = chunk->events[i];
+        auto name = escapeJson(event.name);
+        switch (event.kind) {
+        case EventKind::eZone:
+          file << separator()
+               << std::format("{{\"name\":\"{}\",\"ph\":\"X\",\"pid\":0,"
+                              "\"tid\":{},\"ts\":{:.3f},\"dur\":{:.3f}}}",
+                              name, buffer->id, timestamp(event.begin),
+                              static_cast<double>(event.end - event.begin) /
+                                  1000.0);
+          break;
+        case EventKind::eCounter:
+          file << separator()
+               << std::format("{{\"name\":\"{}\",\"ph\":\"C\",\"pid\":0,"
+                              "\"tid\":{},\"ts\":{:.3f},"
+                              "\"args\":{{\"value\":{}}}}}",
+                              name, buffer->id, timestamp(event.begin),
+                              event.value);
+          break;
+        case EventKind::eFrameMark:
+          file << separator()
+               << std::format("{{\"name\":\"{}\",\"ph\":\"i\",\"s\":\"g\","
+                              "\"pid\":0,\"tid\":{},\"ts\":{:.3f}}}",
+                              name, buffer->id, timestamp(event.begin));
+          break;
+        }
+      }
+    }
+  }
+  file << "\n]}\n";
+  if (!file) {
+    throw std::runtime_error(std::format("failed to write trace {}", path));
+  }
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Scoped zones, counters and frame markers, recorded per thread and exported
+// as a Chrome trace (chrome://tracing, ui.perfetto.dev).
+//
+// Instrumentation goes through the macros below, which compile to nothing
+// unless `ENGINE_CPU_PROFILING` is defined (their arguments are then not
+// evaluated either). When compiled in, nothing is recorded until `start`, and
+// a zone costs a flag check; while recording, it costs two clock reads and an
+// append to a buffer only its thread writes to.
+//
+// Names must be string literals, or otherwise live until the trace is
+// written: only the pointer is stored.
+#ifdef ENGINE_CPU_PROFILING
+#define CPU_PROFILER_CONCAT_(a, b) a##b
+#define CPU_PROFILER_CONCAT(a, b) CPU_PROFILER_CONCAT_(a, b)
+// Times the rest of the enclosing block.
+#define CPU_ZONE(name) CpuZone CPU_PROFILER_CONCAT(cpuZone, __LINE__){name}
+#define CPU_COUNTER(name, value)                                               \
+  CpuProfiler::counter(name, static_cast<double>(value))
+#define CPU_FRAME_MARK() CpuProfiler::frameMark()
+// Names the calling thread in traces.
+#define CPU_THREAD_NAME(name) CpuProfiler::nameThread(name)
+#else
+#define CPU_ZONE(name) static_cast<void>(0)
+#define CPU_COUNTER(name, value) static_cast<void>(0)
+#define CPU_FRAME_MARK() static_cast<void>(0)
+#define CPU_THREAD_NAME(name) static_cast<void>(0)
+#endif
+
+struct CpuProfiler {
+  using Clock = std::chrono::steady_clock;
+
+#ifdef ENGINE_CPU_PROFILING
+  static constexpr bool kCompiledIn = true;
+#else
+  static constexpr bool kCompiledIn = false;
+#endif
+
+  // Events recorded between `start` and `stop` are kept until exit.
+  static void start();
+  static void stop();
+  static inline bool recording() {
+    return _recording.load(std::memory_order_relaxed);
+  }
+
+  static void zone(const char *name, Clock::time_point begin,
+                   Clock::time_point end);
+  static void counter(const char *name, double value);
+  static void frameMark();
+  static void nameThread(std::string name);
+
+  // Writes every event recorded so far, from every thread, as Chrome trace
+  // JSON. Safe to call while other threads record. Throws when `path` can't
+  // be written.
+  static void writeChromeTrace(const std::string &path);
+
+private:
+  static inline std::atomic<bool> _recording = false;
+};
+
+struct CpuZone {
+  explicit CpuZone(const char *name)
+      : _name(name), _recording(CpuProfiler::recording()) {
+    if (_recording) {
+      _begin = CpuProfiler::Clock::now();
+    }
+  }
+  CpuZone(const CpuZone &) = delete;
+  CpuZone &operator=(const CpuZone &) = delete;
+  ~CpuZone() {
+    if (_recording) {
+      CpuProfiler::zone(_name, _begin, CpuProfiler::Clock::now());
+    }
+  }
+
+private:
+  const char *_name;
+  bool _recording;
+  CpuProfiler::Clock::time_point _begin;
+};
@@ -0,0 +1,15 @@
+#include "deletion_queue.hpp"
+
+#include <vector>
+
+void DeletionQueue::collect(uint64_t completedValue) {
+  std::vector<std::unique_ptr<RetiredBase>> done;
+  {
+    std::scoped_lock lock{_mutex};
+    while (!_entries.empty() && _entries.front().value <= completedValue) {
+      done.push_back(std::move(_entries.front().resource));
+      _entries.pop_front();
+    }
+  }
+  // Destroyed outside the lock, as destructors may retire more resources.
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+
+// Resources the GPU may still be using, kept alive until a `Timeline` reaches
+// the value they were retired at. Any movable RAII handle (`vk::Unique*`,
+// `Buffer`, `Texture2D`, whole systems...) can be retired.
+struct DeletionQueue {
+  DeletionQueue() = default;
+  DeletionQueue(const DeletionQueue &) = delete;
+  DeletionQueue &operator=(const DeletionQueue &) = delete;
+
+  // Values must not decrease from one call to the next.
+  template <class T> void retire(uint64_t value, T resource) {
+    std::scoped_lock lock{_mutex};
+    _entries.push_back(
+        {value, std::make_unique<Retired<T>>(std::move(resource))});
+  }
+  // Destroys the resources retired at or before `completedValue`.
+  void collect(uint64_t completedValue);
+
+private:
+  struct RetiredBase {
+    virtual ~RetiredBase() {}
+  };
+  template <class T> struct Retired : RetiredBase {
+    explicit Retired(T resource) : resource(std::move(resource)) {}
+    T resource;
+  };
+  struct Entry {
+    uint64_t value;
+    std::unique_ptr<RetiredBase> resource;
+  };
+
+  std::mutex _mutex;
+  std::deque<Entry> _entries;
+};
@@ -0,0 +1,107 @@
+#include "draw_queue.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+
+const uint64_t kPipelineBits = 16;
+const uint64_t kMeshBits = 16;
+const uint64_t kDepthBits = 32;
+static_assert(kPipelineBits + kMeshBits + kDepthBits == 64);
+
+const size_t kRadixBits = 8;
+const size_t kRadixBuckets = size_t{1} << kRadixBits;
+const size_t kRadixPasses = sizeof(SortKey) * 8 / kRadixBits;
+
+constexpr uint64_t mask(uint64_t bits) { return (uint64_t{1} << bits) - 1; }
+
+template <class TKey, class THash>
+static uint64_t idFor(std::unordered_map<TKey, uint64_t, THash> &ids,
+                      const TKey &key) {
+  auto [it, inserted] = ids.try_emplace(key, ids.size());
+  return it->second;
+}
+
+// Non-negative floats sort the same as their bit patterns, so the top bits of
+// the view depth are enough for a coarse front-to-back order.
+static uint64_t depthBits(const MeshUniforms &uniforms) {
+  // Clip-space w of the mesh origin, i.e. its distance along the view axis.
+  float depth = std::max(uniforms.mvp[3][3], 0.0f);
+  return std::bit_cast<uint32_t>(depth) >> (32 - kDepthBits);
+}
+
+void DrawQueue::clear() {
+  _packets.clear();
+  _order.clear();
+  _worldBounds.clear();
+  _frustum.reset();
+}
+
+void DrawQueue::push(const Material &material, const MeshUniforms &uniforms,
+                     const MeshRange &mesh, const BoundingSphere &bounds,
+                     const BoundingSphere &worldBounds) {
+  auto pipeline = material.vkPipeline();
+  if (!pipeline) {
+    return;
+  }
+  auto pipelineId = idFor(_pipelineIds, pipeline);
+  auto meshId = idFor(_meshIds, mesh);
+  SortKey key = (pipelineId & mask(kPipelineBits)) << (kMeshBits + kDepthBits) |
+                (meshId & mask(kMeshBits)) << kDepthBits | depthBits(uniforms);
+
+  _order.push_back({key, static_cast<uint32_t>(_packets.size())});
+  _packets.push_back({&material,
+                      {uniforms.mvp, material.materialIndex(), {}},
+                      mesh,
+                      bounds});
+  _worldBounds.push(worldBounds);
+}
+
+void DrawQueue::cull() {
+  if (!_frustum.has_value()) {
+    return;
+  }
+  _worldBounds.cull(*_frustum, _visibility);
+  std::erase_if(_order, [&](const SortEntry &entry) {
+    return !isVisible(_visibility, entry.packet);
+  });
+}
+
+// LSD radix sort over the keys, one byte per pass. All histograms are built
+// in a single sweep, and passes where every key shares the same digit (common
+// for the high id bits) are skipped.
+void DrawQueue::sort() {
+  const size_t count = _order.size();
+  if (count == 0) {
+    return;
+  }
+  _scratch.resize(count);
+
+  auto digit = [](SortKey key, size_t pass) {
+    return static_cast<size_t>((key >> (pass * kRadixBits)) &
+                               mask(kRadixBits));
+  };
+  std::array<std::array<uint32_t, kRadixBuckets>, kRadixPasses> histograms{};
+  for (const auto &entry : _order) {
+    for (size_t pass = 0; pass < kRadixPasses; pass++) {
+      histograms[pass][digit(entry.key, pass)]++;
+    }
+  }
+
+  for (size_t pass = 0; pass < kRadixPasses; pass++) {
+    auto &offsets = histograms[pass];
+    if (offsets[digit(_order[0].key, pass)] == count) {
+      continue;
+    }
+    uint32_t offset = 0;
+    for (auto &bucket : offsets) {
+      auto bucketSize = bucket;
+      bucket = offset;
+      offset += bucketSize;
+    }
+    for (const auto &entry : _order) {
+      _scratch[offsets[digit(entry.key, pass)]++] = entry;
+    }
+    std::swap(_order, _scratch);
+  }
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <ranges>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+#include "frustum_culling.hpp"
+#include "material.hpp"
+#include "model.hpp"
+
+using SortKey = uint64_t;
+
+// Everything needed to record a single draw. Kept trivially copyable so the
+// queue can shuffle packets around as plain memory.
+struct DrawPacket {
+  const Material *material;
+  InstanceData instance;
+  MeshRange mesh;
+  BoundingSphere bounds;
+};
+static_assert(std::is_trivially_copyable_v<DrawPacket>);
+
+// Retained list of draws for a frame. Packets are ordered by a 64-bit key
+// which, from most to least significant bits, holds:
+// - pipeline (16 bits);
+// - mesh (16 bits);
+// - view depth (32 bits), so opaque draws end up roughly front-to-back.
+// Materials only differ in their index into the `BindlessHeap` once their
+// pipeline is bound, so they don't take part in the order.
+// Handles are mapped to small ids that persist across frames, so the same
+// material keeps the same position in the order from one frame to the next.
+struct DrawQueue {
+  // Bounds of draws that must never be culled.
+  inline static const BoundingSphere kUnbounded{
+      glm::vec3{0.0f}, std::numeric_limits<float>::infinity()};
+
+  void clear();
+  // `bounds` are in model space, `worldBounds` in world space. Draws whose
+  // material pipeline is still compiling are dropped.
+  void push(const Material &material, const MeshUniforms &uniforms,
+            const MeshRange &mesh, const BoundingSphere &bounds,
+            const BoundingSphere &worldBounds);
+  inline void push(const Material &material, const MeshUniforms &uniforms,
+                   const Model &model) {
+    push(material, uniforms, model.range(), model.bounds(), kUnbounded);
+  }
+  inline void push(const Material &material, const MeshUniforms &uniforms,
+                   const Model &model, const glm::mat4 &world) {
+    push(material, uniforms, model.range(), model.bounds(),
+         transformBounds(model.bounds(), world));
+  }
+  // Camera used by `cull`, reset by `clear`.
+  inline void setViewProjection(const glm::mat4 &viewProjection) {
+    _frustum = Frustum::fromMatrix(viewProjection);
+  }
+  // Drops the draws whose world bounds are outside the camera's frustum, if
+  // one was set.
+  void cull();
+  void sort();
+
+  inline size_t size() const { return _packets.size(); }
+  inline bool empty() const { return _packets.empty(); }
+  // Draws left after culling.
+  inline size_t visibleSize() const { return _order.size(); }
+  // Packets in key order. Only meaningful after `sort`.
+  inline auto sorted() const {
+    return _order |
+           std::views::transform([this](const auto &entry) -> const auto & {
+             return _packets[entry.packet];
+           });
+  }
+
+private:
+  struct SortEntry {
+    SortKey key;
+    uint32_t packet;
+  };
+  struct MeshRangeHash {
+    size_t operator()(const MeshRange &mesh) const {
+      return std::hash<vk::Buffer>{}(mesh.vertexBuffer) ^
+             std::hash<vk::Buffer>{}(mesh.indexBuffer) ^
+             (static_cast<size_t>(mesh.firstIndex) << 32) ^
+             static_cast<size_t>(static_cast<uint32_t>(mesh.vertexOffset));
+    }
+  };
+
+  std::vector<DrawPacket> _packets;
+  std::vector<SortEntry> _order;
+  std::vector<SortEntry> _scratch;
+  BoundingSpheres _worldBounds;
+  VisibilityMask _visibility;
+  std::optional<Frustum> _frustum;
+  std::unordered_map<vk::Pipeline, uint64_t> _pipelineIds;
+  std::unordered_map<MeshRange, uint64_t, MeshRangeHash> _meshIds;
+};
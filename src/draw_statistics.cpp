@@ -0,0 +1,100 @@
+#include "draw_statistics.hpp"
+
+#include <algorithm>
+
+#include "graphics_device.hpp"
+
+// In the order results are written, that of the flag bits.
+const vk::QueryPipelineStatisticFlags kStatistics =
+    vk::QueryPipelineStatisticFlagBits::eVertexShaderInvocations |
+    vk::QueryPipelineStatisticFlagBits::eClippingPrimitives |
+    vk::QueryPipelineStatisticFlagBits::eFragmentShaderInvocations;
+
+DrawStatistics DrawStatistics::create(const GraphicsDevice &device) {
+  auto vkDevice = device.vkDevice();
+  if (!device.features().pipelineStatisticsQuery) {
+    return {vkDevice, {}};
+  }
+  auto queryPool = vkDevice.createQueryPoolUnique(
+      vk::QueryPoolCreateInfo{}
+          .setQueryType(vk::QueryType::ePipelineStatistics)
+          .setQueryCount(static_cast<uint32_t>(
+              RenderTarget::kMaxConcurrentFrames * kMaxDrawsPerFrame))
+          .setPipelineStatistics(kStatistics));
+  return {vkDevice, std::move(queryPool)};
+}
+
+void DrawStatistics::beginFrame(FrameIndex frame, vk::CommandBuffer cmd,
+                                std::span<const std::string_view> drawNames,
+                                uint64_t pixelCount) {
+  read(frame);
+  if (!_enabled) {
+    return;
+  }
+  auto drawCount = std::min<size_t>(drawNames.size(), kMaxDrawsPerFrame);
+  if (drawCount == 0) {
+    return;
+  }
+  auto &queries = _frames[frame];
+  queries.names.assign(drawNames.begin(), drawNames.begin() + drawCount);
+  queries.pixelCount = pixelCount;
+  cmd.resetQueryPool(_queryPool.get(), query(frame, 0),
+                     static_cast<uint32_t>(drawCount));
+}
+
+void DrawStatistics::begin(FrameIndex frame, vk::CommandBuffer cmd,
+                           size_t draw) const {
+  if (draw < _frames[frame].names.size()) {
+    cmd.beginQuery(_queryPool.get(), query(frame, draw), {});
+  }
+}
+
+void DrawStatistics::end(FrameIndex frame, vk::CommandBuffer cmd,
+                         size_t draw) const {
+  if (draw < _frames[frame].names.size()) {
+    cmd.endQuery(_queryPool.get(), query(frame, draw));
+  }
+}
+
+void DrawStatistics::collect() {
+  for (FrameIndex frame = 0; frame < _frames.size(); frame++) {
+    read(frame);
+  }
+}
+
+void DrawStatistics::read(FrameIndex frame) {
+  auto &queries = _frames[frame];
+  auto drawCount = static_cast<uint32_t>(queries.names.size());
+  if (drawCount == 0) {
+    return;
+  }
+  _results.resize(drawCount);
+  // Every query reset by `beginFrame` is written by the frame, so results are
+  // only not ready when the frame was never submitted (e.g. the render system
+  // was recreated in between), in which case it is dropped.
+  auto result = _device.getQueryPoolResults(
+      _queryPool.get(), query(frame, 0), drawCount,
+      drawCount * sizeof(Counters), _results.data(), sizeof(Counters),
+      vk::QueryResultFlagBits::e64);
+  if (result == vk::Result::eSuccess) {
+    _drawn.clear();
+    for (uint32_t draw = 0; draw < drawCount; draw++) {
+      auto [it, inserted] =
+          _statIndices.try_emplace(queries.names[draw], _stats.size());
+      if (inserted) {
+        _stats.push_back({queries.names[draw], 0, 0, {}, 0});
+      }
+      auto &stats = _stats[it->second];
+      if (!std::ranges::contains(_drawn, it->second)) {
+        _drawn.push_back(it->second);
+        stats.frames++;
+        stats.pixels += queries.pixelCount;
+      }
+      stats.draws++;
+      stats.total.vertexInvocations += _results[draw].vertexInvocations;
+      stats.total.clippingPrimitives += _results[draw].clippingPrimitives;
+      stats.total.fragmentInvocations += _results[draw].fragmentInvocations;
+    }
+  }
+  queries.names.clear();
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+#include "render_target.hpp"
+
+struct GraphicsDevice;
+// Counts the vertex shader invocations, primitives output by clipping and
+// fragment shader invocations of every draw with pipeline statistics queries.
+// Fragments rejected by early depth tests are never shaded, so comparing a
+// draw's fragment invocations to the pixels of the target shows how much
+// shading its position in the draw order wastes. A frame's queries are read
+// back once its index comes around again, when the GPU is done with it, so
+// reading never stalls.
+//
+// Disabled by default. When enabled, every draw is wrapped in a query, which
+// may keep drivers from overlapping draws.
+struct DrawStatistics {
+  static constexpr uint32_t kMaxDrawsPerFrame = 1024;
+  // Draw index of draws that aren't counted
+  static constexpr size_t kNotCounted = std::numeric_limits<size_t>::max();
+
+  struct Counters {
+    uint64_t vertexInvocations;
+    uint64_t clippingPrimitives;
+    uint64_t fragmentInvocations;
+  };
+  // Draws sharing a name (e.g. those of a material) add up.
+  struct DrawStats {
+    std::string name;
+    // Frames the name was drawn in
+    uint64_t frames;
+    uint64_t draws;
+    Counters total;
+    // Pixels of the target, summed over `frames`
+    uint64_t pixels;
+  };
+
+  // `queryPool` is null when the device can't count pipeline statistics.
+  DrawStatistics(vk::Device device, vk::UniqueQueryPool queryPool)
+      : _device(device), _queryPool(std::move(queryPool)) {}
+
+  static DrawStatistics create(const GraphicsDevice &device);
+
+  inline bool supported() const { return static_cast<bool>(_queryPool); }
+  inline bool enabled() const { return _enabled; }
+  // Ignored unless `supported`.
+  inline void setEnabled(bool enabled) { _enabled = enabled && supported(); }
+
+  // Reads back the previous queries of `frame`, which the GPU must be done
+  // with, and resets them for draws named `drawNames`, indexed by draw. Each
+  // of them must be recorded, or none of the frame's results become
+  // available. `cmd` must be outside of any render pass. Draws past
+  // `kMaxDrawsPerFrame` aren't counted.
+  void beginFrame(FrameIndex frame, vk::CommandBuffer cmd,
+                  std::span<const std::string_view> drawNames,
+                  uint64_t pixelCount);
+  // Records nothing unless `draw` was named when beginning `frame`. Safe to
+  // call from several threads.
+  void begin(FrameIndex frame, vk::CommandBuffer cmd, size_t draw) const;
+  void end(FrameIndex frame, vk::CommandBuffer cmd, size_t draw) const;
+  // Reads back every frame. The GPU must be done with all of them, e.g. after
+  // `GraphicsDevice::waitIdle`.
+  void collect();
+
+  // In order of first appearance
+  inline const std::vector<DrawStats> &stats() const { return _stats; }
+
+private:
+  struct FrameQueries {
+    std::vector<std::string> names;
+    uint64_t pixelCount = 0;
+  };
+
+  inline uint32_t query(FrameIndex frame, size_t draw) const {
+    return static_cast<uint32_t>(frame * kMaxDrawsPerFrame + draw);
+  }
+  void read(FrameIndex frame);
+
+  vk::Device _device;
+  vk::UniqueQueryPool _queryPool;
+  bool _enabled = false;
+  std::array<FrameQueries, RenderTarget::kMaxConcurrentFrames> _frames;
+  std::vector<Counters> _results;
+  std::vector<DrawStats> _stats;
+  std::unordered_map<std::string, size_t> _statIndices;
+  // Scratch space for `read`: entries the frame drew
+  std::vector<size_t> _drawn;
+};
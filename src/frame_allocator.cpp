@@ -0,0 +1,73 @@
+#include "frame_allocator.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "bindless_heap.hpp"
+#include "graphics_device.hpp"
+
+// The uniform range past the last allocation of the last region must still
+// lie in the buffer.
+static Buffer createBuffer(const GraphicsDevice &device) {
+  return Buffer::createMapped(
+      device,
+      vk::BufferUsageFlagBits::eUniformBuffer |
+          vk::BufferUsageFlagBits::eStorageBuffer |
+          vk::BufferUsageFlagBits::eVertexBuffer,
+      RenderTarget::kMaxConcurrentFrames * FrameAllocator::kRegionSize +
+          FrameAllocator::kMaxUniformSize);
+}
+
+FrameAllocator::FrameAllocator(const GraphicsDevice &device,
+                               const BindlessHeap &heap)
+    : _buffer(createBuffer(device)) {
+  auto vkDevice = device.vkDevice();
+  const auto &limits = device.vkPhysicalDevice().getProperties().limits;
+  _alignment = std::max({limits.minUniformBufferOffsetAlignment,
+                         limits.minStorageBufferOffsetAlignment,
+                         vk::DeviceSize{16}});
+
+  auto poolSize =
+      vk::DescriptorPoolSize{vk::DescriptorType::eUniformBufferDynamic, 1};
+  _vkDescriptorPool = vkDevice.createDescriptorPoolUnique(
+      vk::DescriptorPoolCreateInfo{}.setMaxSets(1).setPoolSizes(poolSize));
+  auto setLayout = heap.vkFrameUniformSetLayout();
+  _descriptorSet = vkDevice.allocateDescriptorSets(
+      vk::DescriptorSetAllocateInfo{}
+          .setSetLayouts(setLayout)
+          .setDescriptorPool(_vkDescriptorPool.get()))[0];
+  auto bufferInfo = vk::DescriptorBufferInfo{}
+                        .setBuffer(_buffer.vkBuffer())
+                        .setRange(kMaxUniformSize);
+  vkDevice.updateDescriptorSets(
+      vk::WriteDescriptorSet{}
+          .setDstSet(_descriptorSet)
+          .setDstBinding(0)
+          .setDescriptorCount(1)
+          .setDescriptorType(vk::DescriptorType::eUniformBufferDynamic)
+          .setBufferInfo(bufferInfo),
+      {});
+}
+
+void FrameAllocator::beginFrame(FrameIndex frame) {
+  _head.store(frame * kRegionSize, std::memory_order_relaxed);
+  _end = (frame + 1) * kRegionSize;
+}
+
+FrameAllocator::Allocation FrameAllocator::allocate(vk::DeviceSize size) {
+  // Sizes are rounded up, so the head stays aligned.
+  auto alignedSize = (size + _alignment - 1) / _alignment * _alignment;
+  auto offset = _head.fetch_add(alignedSize, std::memory_order_relaxed);
+  if (offset + alignedSize > _end) {
+    throw std::runtime_error("frame allocator is out of space");
+  }
+  return {static_cast<uint32_t>(offset), _buffer.mappedData() + offset};
+}
+
+void FrameAllocator::bindUniforms(vk::CommandBuffer cmd,
+                                  vk::PipelineLayout layout,
+                                  uint32_t offset) const {
+  cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout,
+                         BindlessHeap::kFrameUniformSet, _descriptorSet,
+                         offset);
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#include <vulkan/vulkan.hpp>
+
+#include "buffer.hpp"
+#include "render_target.hpp"
+
+struct BindlessHeap;
+struct GraphicsDevice;
+// Linear allocator for data the CPU writes and the GPU reads within a single
+// frame, e.g. per-frame material uniforms. A persistently mapped buffer is
+// split in one region per frame in flight. Each frame bumps an offset through
+// its region, which starts over when the frame's index comes around again,
+// once the GPU is done with it. Allocating costs an atomic add, with no
+// allocation, staging copy or queue wait, and may happen from several
+// threads.
+//
+// Uniforms are read from `BindlessHeap::kFrameUniformSet`, bound at their
+// allocation with `bindUniforms`.
+struct FrameAllocator {
+  // Bytes of uniforms readable from an allocation, the range of the dynamic
+  // uniform buffer
+  static constexpr vk::DeviceSize kMaxUniformSize = 1024;
+  // Bytes per frame in flight
+  static constexpr vk::DeviceSize kRegionSize = 256 * 1024;
+
+  struct Allocation {
+    // Offset in `vkBuffer`, also the dynamic offset of uniforms
+    uint32_t offset;
+    std::byte *data;
+  };
+
+  // `heap` provides the layout of the uniform set.
+  FrameAllocator(const GraphicsDevice &device, const BindlessHeap &heap);
+  FrameAllocator(const FrameAllocator &) = delete;
+  FrameAllocator &operator=(const FrameAllocator &) = delete;
+
+  inline vk::Buffer vkBuffer() const { return _buffer.vkBuffer(); }
+
+  // Starts allocating from the region of `frame`, dropping what was allocated
+  // from it before. Not synchronized with `allocate`.
+  void beginFrame(FrameIndex frame);
+  // Allocations are aligned for uniform and storage buffers. Throws when the
+  // frame's region is full.
+  Allocation allocate(vk::DeviceSize size);
+  // Allocates a copy of `value`, returning its offset.
+  template <class T> inline uint32_t push(const T &value) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    auto allocation = allocate(sizeof(T));
+    std::memcpy(allocation.data, &value, sizeof(T));
+    return allocation.offset;
+  }
+  // Binds the uniforms at `offset` for graphics pipelines created with
+  // `layout`, which must be the `BindlessHeap`'s.
+  void bindUniforms(vk::CommandBuffer cmd, vk::PipelineLayout layout,
+                    uint32_t offset) const;
+
+private:
+  Buffer _buffer;
+  vk::DeviceSize _alignment;
+  vk::UniqueDescriptorPool _vkDescriptorPool;
+  vk::DescriptorSet _descriptorSet;
+  std::atomic<vk::DeviceSize> _head = 0;
+  vk::DeviceSize _end = 0;
+};
@@ -0,0 +1,73 @@
+#include "frame_scheduler.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+
+// Sleeps end this early, and the rest of the wait is spun. Covers the usual
+// scheduler granularity without spinning for long.
+const FrameScheduler::Clock::duration kSpinMargin =
+    std::chrono::milliseconds(2);
+// Time simulated per frame is clamped to this, so a long stall (e.g. a
+// debugger break or a window drag) does not trigger a burst of steps.
+const FrameScheduler::Clock::duration kMaxFrameLag =
+    std::chrono::milliseconds(250);
+
+FrameScheduler::FrameScheduler(Clock::duration step,
+                               std::optional<Clock::duration> framePeriod)
+    : _step(step), _framePeriod(framePeriod) {}
+
+FrameScheduler FrameScheduler::create(uint64_t simulationRate,
+                                      uint64_t maxFrameRate) {
+  if (simulationRate == 0) {
+    throw std::runtime_error("simulation rate must be positive");
+  }
+  auto periodOf = [](uint64_t rate) {
+    return Clock::duration{std::chrono::seconds{1}} /
+           static_cast<Clock::rep>(rate);
+  };
+  return {periodOf(simulationRate),
+          maxFrameRate > 0 ? std::optional{periodOf(maxFrameRate)}
+                           : std::nullopt};
+}
+
+FrameScheduler::Tick FrameScheduler::beginFrame() {
+  auto now = Clock::now();
+  if (_framePeriod.has_value() && _lastFrame.has_value()) {
+    _deadline += *_framePeriod;
+    // Once a frame is late by a whole period, the schedule starts over from
+    // it instead of rushing the next frames to catch up.
+    if (_deadline + *_framePeriod < now) {
+      _deadline = now;
+    }
+    waitUntil(_deadline);
+    now = Clock::now();
+  } else {
+    _deadline = now;
+  }
+
+  if (_lastFrame.has_value()) {
+    auto elapsed = now - *_lastFrame;
+    if (_frameTimes.size() < kFrameTimeWindow) {
+      _frameTimes.push_back(elapsed);
+    } else {
+      _frameTimes[_nextFrameTime] = elapsed;
+      _nextFrameTime = (_nextFrameTime + 1) % kFrameTimeWindow;
+    }
+    _lag += std::min(elapsed, kMaxFrameLag);
+  }
+  _lastFrame = now;
+
+  auto steps = static_cast<uint64_t>(_lag / _step);
+  _lag -= _step * static_cast<Clock::rep>(steps);
+  return {steps, Duration{_lag} / Duration{_step}};
+}
+
+void FrameScheduler::waitUntil(Clock::time_point deadline) {
+  if (Clock::now() + kSpinMargin < deadline) {
+    std::this_thread::sleep_until(deadline - kSpinMargin);
+  }
+  while (Clock::now() < deadline) {
+    std::this_thread::yield();
+  }
+}
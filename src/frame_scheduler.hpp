@@ -0,0 +1,59 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+// Paces the main loop on `steady_clock`, and splits elapsed time into fixed
+// simulation steps, so the simulation advances the same way at any frame
+// rate. Frames are capped by waiting for deadlines spaced by the frame
+// period, rather than sleeping for a period after each frame, so waits
+// overshooting never add up.
+struct FrameScheduler {
+  using Clock = std::chrono::steady_clock;
+  using Duration = std::chrono::duration<float, std::milli>;
+
+  struct Tick {
+    // Fixed steps to simulate before rendering the frame.
+    uint64_t steps;
+    // How far the frame is between the last two simulated states, in [0, 1),
+    // to interpolate them.
+    float alpha;
+  };
+
+  // Frames are uncapped without a `framePeriod`.
+  FrameScheduler(Clock::duration step,
+                 std::optional<Clock::duration> framePeriod);
+
+  // `maxFrameRate` of 0 leaves frames uncapped.
+  static FrameScheduler create(uint64_t simulationRate, uint64_t maxFrameRate);
+
+  // Waits until the next frame is due, then returns what to simulate.
+  Tick beginFrame();
+
+  // Frame times kept, the most recent ones.
+  static constexpr size_t kFrameTimeWindow = 10000;
+
+  inline Clock::duration step() const { return _step; }
+  // Time from the start of each frame to the start of the next one, over the
+  // last `kFrameTimeWindow` frames at most, in no particular order.
+  inline std::span<const Duration> frameTimes() const { return _frameTimes; }
+
+private:
+  // Sleeps for most of the wait, then spins, as sleeps overshoot by up to a
+  // scheduler tick.
+  static void waitUntil(Clock::time_point deadline);
+
+  Clock::duration _step;
+  std::optional<Clock::duration> _framePeriod;
+  std::optional<Clock::time_point> _lastFrame;
+  Clock::time_point _deadline;
+  // Elapsed time not simulated yet, below a step after each `beginFrame`.
+  Clock::duration _lag{};
+  // Ring of frame times, overwritten from `_nextFrameTime` once full.
+  std::vector<Duration> _frameTimes;
+  size_t _nextFrameTime = 0;
+};
@@ -0,0 +1,173 @@
+#include "frustum_culling.hpp"
+
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#define CULLING_SSE 1
+#endif
+// AVX2 kernels are compiled through target attributes and picked at runtime,
+// which MSVC does not support.
+#if defined(CULLING_SSE) && defined(__GNUC__)
+#define CULLING_AVX2 1
+#endif
+
+Frustum Frustum::fromMatrix(const glm::mat4 &m) {
+  auto row = [&](glm::length_t i) {
+    return glm::vec4{m[0][i], m[1][i], m[2][i], m[3][i]};
+  };
+  // Clip volume is -w <= x, y <= w and 0 <= z <= w.
+  Frustum frustum{{
+      row(3) + row(0),
+      row(3) - row(0),
+      row(3) + row(1),
+      row(3) - row(1),
+      row(2),
+      row(3) - row(2),
+  }};
+  for (auto &plane : frustum.planes) {
+    plane /= glm::length(glm::vec3{plane});
+  }
+  return frustum;
+}
+
+void BoundingSpheres::clear() {
+  _x.clear();
+  _y.clear();
+  _z.clear();
+  _radius.clear();
+}
+
+void BoundingSpheres::push(const BoundingSphere &sphere) {
+  _x.push_back(sphere.center.x);
+  _y.push_back(sphere.center.y);
+  _z.push_back(sphere.center.z);
+  _radius.push_back(sphere.radius);
+}
+
+namespace {
+struct SphereArrays {
+  const float *x;
+  const float *y;
+  const float *z;
+  const float *radius;
+};
+} // namespace
+
+// Each kernel handles as many whole blocks of its width as fit in
+// [begin, end) and returns where it stopped. `begin` must be a multiple of the
+// width so a block never straddles two mask words.
+static size_t cullScalar(const SphereArrays &spheres, const Frustum &frustum,
+                         size_t begin, size_t end, uint64_t *words) {
+  for (size_t i = begin; i < end; i++) {
+    bool visible = true;
+    for (const auto &plane : frustum.planes) {
+      float distance = plane.x * spheres.x[i] + plane.y * spheres.y[i] +
+                       plane.z * spheres.z[i] + plane.w;
+      visible = visible && distance >= -spheres.radius[i];
+    }
+    words[i / 64] |= static_cast<uint64_t>(visible) << (i % 64);
+  }
+  return end;
+}
+
+#ifdef CULLING_SSE
+static size_t cullSse(const SphereArrays &spheres, const Frustum &frustum,
+                      size_t begin, size_t end, uint64_t *words) {
+  size_t i = begin;
+  for (; i + 4 <= end; i += 4) {
+    auto x = _mm_loadu_ps(spheres.x + i);
+    auto y = _mm_loadu_ps(spheres.y + i);
+    auto z = _mm_loadu_ps(spheres.z + i);
+    auto minDistance =
+        _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(spheres.radius + i));
+    auto inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+    for (const auto &plane : frustum.planes) {
+      auto distance = _mm_add_ps(
+          _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.x), x),
+                     _mm_mul_ps(_mm_set1_ps(plane.y), y)),
+          _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.z), z),
+                     _mm_set1_ps(plane.w)));
+      inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, minDistance));
+    }
+    auto bits = static_cast<uint32_t>(_mm_movemask_ps(inside));
+    words[i / 64] |= static_cast<uint64_t>(bits) << (i % 64);
+  }
+  return i;
+}
+#endif
+
+#ifdef CULLING_AVX2
+__attribute__((target("avx2,fma"))) static size_t
+cullAvx2(const SphereArrays &spheres, const Frustum &frustum, size_t begin,
+         size_t end, uint64_t *words) {
+  size_t i = begin;
+  for (; i + 8 <= end; i += 8) {
+    auto x = _mm256_loadu_ps(spheres.x + i);
+    auto y = _mm256_loadu_ps(spheres.y + i);
+    auto z = _mm256_loadu_ps(spheres.z + i);
+    auto minDistance = _mm256_sub_ps(_mm256_setzero_ps(),
+                                     _mm256_loadu_ps(spheres.radius + i));
+    auto inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+    for (const auto &plane : frustum.planes) {
+      auto distance = _mm256_fmadd_ps(
+          _mm256_set1_ps(plane.x), x,
+          _mm256_fmadd_ps(_mm256_set1_ps(plane.y), y,
+                          _mm256_fmadd_ps(_mm256_set1_ps(plane.z), z,
+                                          _mm256_set1_ps(plane.w))));
+      inside = _mm256_and_ps(
+          inside, _mm256_cmp_ps(distance, minDistance, _CMP_GE_OQ));
+    }
+    auto bits = static_cast<uint32_t>(_mm256_movemask_ps(inside));
+    words[i / 64] |= static_cast<uint64_t>(bits) << (i % 64);
+  }
+  return i;
+}
+#endif
+
+CullingKernel BoundingSpheres::bestKernel() {
+#ifdef CULLING_AVX2
+  static const bool hasAvx2 =
+      __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+  if (hasAvx2) {
+    return CullingKernel::eAvx2;
+  }
+#endif
+#ifdef CULLING_SSE
+  return CullingKernel::eSse;
+#else
+  return CullingKernel::eScalar;
+#endif
+}
+
+void BoundingSpheres::cull(const Frustum &frustum, VisibilityMask &visible,
+                           CullingKernel kernel) const {
+  const size_t count = size();
+  visible.assign((count + 63) / 64, 0);
+  SphereArrays spheres{_x.data(), _y.data(), _z.data(), _radius.data()};
+  size_t done = 0;
+  switch (kernel) {
+  case CullingKernel::eAvx2:
+#ifdef CULLING_AVX2
+    done = cullAvx2(spheres, frustum, 0, count, visible.data());
+    break;
+#endif
+  case CullingKernel::eSse:
+#ifdef CULLING_SSE
+    done = cullSse(spheres, frustum, 0, count, visible.data());
+    break;
+#endif
+  case CullingKernel::eScalar:
+    break;
+  }
+  cullScalar(spheres, frustum, done, count, visible.data());
+}
+
+BoundingSphere transformBounds(const BoundingSphere &sphere,
+                               const glm::mat4 &world) {
+  float scale = std::max({glm::length(glm::vec3{world[0]}),
+                          glm::length(glm::vec3{world[1]}),
+                          glm::length(glm::vec3{world[2]})});
+  return {glm::vec3{world * glm::vec4{sphere.center, 1.0f}},
+          sphere.radius * scale};
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "model.hpp"
+
+// Planes bounding the view volume of a view-projection matrix, normalized so
+// that `dot(plane.xyz, point) + plane.w` is the signed distance of `point` to
+// the plane, positive inside.
+struct Frustum {
+  std::array<glm::vec4, 6> planes;
+
+  static Frustum fromMatrix(const glm::mat4 &viewProjection);
+};
+
+// One bit per object, set when the object is visible.
+using VisibilityMask = std::vector<uint64_t>;
+
+inline bool isVisible(const VisibilityMask &mask, size_t index) {
+  return (mask[index / 64] >> (index % 64)) & 1;
+}
+
+enum class CullingKernel {
+  eScalar,
+  // 4 spheres per iteration, x86-64 only.
+  eSse,
+  // 8 spheres per iteration, x86-64 CPUs with AVX2 and FMA only.
+  eAvx2,
+};
+
+// World-space bounding spheres stored as a structure of arrays, so they can be
+// tested against a frustum several at a time.
+struct BoundingSpheres {
+  void clear();
+  void push(const BoundingSphere &sphere);
+  inline size_t size() const { return _radius.size(); }
+
+  // Fastest kernel supported by the running CPU.
+  static CullingKernel bestKernel();
+  // Overwrites `visible` with the spheres intersecting `frustum`.
+  void cull(const Frustum &frustum, VisibilityMask &visible,
+            CullingKernel kernel = bestKernel()) const;
+
+private:
+  std::vector<float> _x;
+  std::vector<float> _y;
+  std::vector<float> _z;
+  std::vector<float> _radius;
+};
+
+// Bounds of `sphere` once transformed by `world`, which may scale but not
+// shear.
+BoundingSphere transformBounds(const BoundingSphere &sphere,
+                               const glm::mat4 &world);
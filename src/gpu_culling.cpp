@@ -0,0 +1,109 @@
+#include "gpu_culling.hpp"
+
+#include <array>
+
+#include "graphics_device.hpp"
+#include "materials/utils.hpp"
+
+const auto kShaderPath = "./assets/shaders/frustum_cull.comp.spv";
+// Must match `numthreads` in `frustum_cull.comp`.
+const uint32_t kGroupSize = 64;
+
+GpuCulling GpuCulling::create(const GraphicsDevice &device) {
+  auto vkDevice = device.vkDevice();
+
+  auto poolSizes = std::to_array<vk::DescriptorPoolSize>({
+      {vk::DescriptorType::eStorageBuffer,
+       3 * RenderTarget::kMaxConcurrentFrames},
+  });
+  auto descriptorPool = vkDevice.createDescriptorPoolUnique(
+      vk::DescriptorPoolCreateInfo{}
+          .setMaxSets(RenderTarget::kMaxConcurrentFrames)
+          .setPoolSizes(poolSizes));
+
+  auto setBindings = std::to_array<vk::DescriptorSetLayoutBinding>({
+      {0, vk::DescriptorType::eStorageBuffer, 1,
+       vk::ShaderStageFlagBits::eCompute},
+      {1, vk::DescriptorType::eStorageBuffer, 1,
+       vk::ShaderStageFlagBits::eCompute},
+      {2, vk::DescriptorType::eStorageBuffer, 1,
+       vk::ShaderStageFlagBits::eCompute},
+  });
+  auto setLayout = vkDevice.createDescriptorSetLayoutUnique(
+      vk::DescriptorSetLayoutCreateInfo{}.setBindings(setBindings));
+  auto pushConstantRanges = std::to_array({vk::PushConstantRange{
+      vk::ShaderStageFlagBits::eCompute, 0, sizeof(uint32_t)}});
+  auto pipelineLayout = vkDevice.createPipelineLayoutUnique(
+      vk::PipelineLayoutCreateInfo{}
+          .setSetLayouts(setLayout.get())
+          .setPushConstantRanges(pushConstantRanges));
+
+  std::array<vk::DescriptorSetLayout, RenderTarget::kMaxConcurrentFrames>
+      setLayouts;
+  setLayouts.fill(setLayout.get());
+  auto descriptorSets = vkDevice.allocateDescriptorSets(
+      vk::DescriptorSetAllocateInfo{}
+          .setSetLayouts(setLayouts)
+          .setDescriptorPool(descriptorPool.get()));
+
+  auto shaderModule = loadShaderFromPath(kShaderPath, vkDevice);
+  auto pipeline =
+      vkDevice
+          .createComputePipelineUnique(
+              device.pipelineCache(),
+              vk::ComputePipelineCreateInfo{}
+                  .setStage(vk::PipelineShaderStageCreateInfo{
+                      {},
+                      vk::ShaderStageFlagBits::eCompute,
+                      shaderModule.get(),
+                      "main"})
+                  .setLayout(pipelineLayout.get()))
+          .value;
+
+  return {std::move(descriptorPool), std::move(setLayout),
+          std::move(pipelineLayout), std::move(descriptorSets),
+          std::move(shaderModule),   std::move(pipeline)};
+}
+
+void GpuCulling::record(const GraphicsDevice &device, FrameIndex frame,
+                        vk::CommandBuffer cmd, vk::Buffer objects,
+                        vk::Buffer commands, vk::Buffer instances,
+                        uint32_t objectCount) const {
+  auto descriptorSet = _descriptorSets[frame];
+  // Buffers are regrown on demand, so the set is rewritten every frame. The
+  // frame's previous submission is known to be done at this point.
+  auto bufferInfos = std::to_array({
+      vk::DescriptorBufferInfo{objects, 0, vk::WholeSize},
+      vk::DescriptorBufferInfo{commands, 0, vk::WholeSize},
+      vk::DescriptorBufferInfo{instances, 0, vk::WholeSize},
+  });
+  std::array<vk::WriteDescriptorSet, bufferInfos.size()> descriptorWrites;
+  for (uint32_t i = 0; i < bufferInfos.size(); i++) {
+    descriptorWrites[i] =
+        vk::WriteDescriptorSet{}
+            .setDstSet(descriptorSet)
+            .setDstBinding(i)
+            .setDescriptorCount(1)
+            .setDescriptorType(vk::DescriptorType::eStorageBuffer)
+            .setBufferInfo(bufferInfos[i]);
+  }
+  device.vkDevice().updateDescriptorSets(descriptorWrites, {});
+
+  cmd.bindPipeline(vk::PipelineBindPoint::eCompute, _vkPipeline.get());
+  cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute,
+                         _vkPipelineLayout.get(), 0, descriptorSet, {});
+  cmd.pushConstants<uint32_t>(_vkPipelineLayout.get(),
+                              vk::ShaderStageFlagBits::eCompute, 0,
+                              objectCount);
+  cmd.dispatch((objectCount + kGroupSize - 1) / kGroupSize, 1, 1);
+
+  auto barrier =
+      vk::MemoryBarrier{}
+          .setSrcAccessMask(vk::AccessFlagBits::eShaderWrite)
+          .setDstAccessMask(vk::AccessFlagBits::eIndirectCommandRead |
+                            vk::AccessFlagBits::eVertexAttributeRead);
+  cmd.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+                      vk::PipelineStageFlagBits::eDrawIndirect |
+                          vk::PipelineStageFlagBits::eVertexInput,
+                      {}, barrier, {}, {});
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <array>
+
+#include <vulkan/vulkan.hpp>
+
+#include <glm/glm.hpp>
+
+#include "material.hpp"
+#include "render_target.hpp"
+
+// Per-object input of the culling shader. Must match `Object` in
+// `frustum_cull.comp`.
+struct CullObject {
+  InstanceData instance;
+  // Bounding sphere in model space: center in xyz, radius in w.
+  glm::vec4 sphere;
+  // Indirect command whose instances the object is appended to.
+  uint32_t command;
+  uint32_t padding[3];
+};
+static_assert(sizeof(CullObject) == 112);
+
+struct GraphicsDevice;
+// Compute pass testing every object against the frustum of its own MVP matrix.
+// Visible objects are compacted into the instance range of their indirect
+// command, whose `instanceCount` serves as the atomic counter, so the CPU
+// never looks at per-object visibility.
+struct GpuCulling {
+  GpuCulling(vk::UniqueDescriptorPool vkDescriptorPool,
+             vk::UniqueDescriptorSetLayout vkSetLayout,
+             vk::UniquePipelineLayout vkPipelineLayout,
+             std::vector<vk::DescriptorSet> descriptorSets,
+             vk::UniqueShaderModule vkShaderModule,
+             vk::UniquePipeline vkPipeline)
+      : _vkDescriptorPool(std::move(vkDescriptorPool)),
+        _vkSetLayout(std::move(vkSetLayout)),
+        _vkPipelineLayout(std::move(vkPipelineLayout)),
+        _descriptorSets(std::move(descriptorSets)),
+        _vkShaderModule(std::move(vkShaderModule)),
+        _vkPipeline(std::move(vkPipeline)) {}
+
+  static GpuCulling create(const GraphicsDevice &device);
+
+  // Records the culling of `objectCount` objects, followed by a barrier making
+  // `commands` and `instances` available to indirect draws. The commands'
+  // `instanceCount` must be zero.
+  void record(const GraphicsDevice &device, FrameIndex frame,
+              vk::CommandBuffer cmd, vk::Buffer objects, vk::Buffer commands,
+              vk::Buffer instances, uint32_t objectCount) const;
+
+private:
+  vk::UniqueDescriptorPool _vkDescriptorPool;
+  vk::UniqueDescriptorSetLayout _vkSetLayout;
+  vk::UniquePipelineLayout _vkPipelineLayout;
+  std::vector<vk::DescriptorSet> _descriptorSets;
+  vk::UniqueShaderModule _vkShaderModule;
+  vk::UniquePipeline _vkPipeline;
+};
@@ -0,0 +1,213 @@
+#include "gpu_profiler.hpp"
+
+#include <algorithm>
+#include <array>
+#include <utility>
+
+#include "timeline.hpp"
+
+GpuProfiler::GpuProfiler(vk::Device device, vk::PhysicalDevice physicalDevice,
+                         uint32_t queueFamily, bool calibrated)
+    : _device(device), _batches(kMaxBatches),
+      _timestamps(kMaxScopesPerBatch * 2) {
+  _timestampPeriod = physicalDevice.getProperties().limits.timestampPeriod;
+  auto validBits = physicalDevice.getQueueFamilyProperties()[queueFamily]
+                       .timestampValidBits;
+  _timestampMask = validBits >= 64 ? std::numeric_limits<uint64_t>::max()
+                                   : (uint64_t{1} << validBits) - 1;
+  // Not part of the static dispatcher, since the extension is optional.
+  _getCalibratedTimestamps =
+      calibrated ? reinterpret_cast<PFN_vkGetCalibratedTimestampsEXT>(
+                       device.getProcAddr("vkGetCalibratedTimestampsEXT"))
+                 : nullptr;
+  _queryPool = device.createQueryPoolUnique(
+      vk::QueryPoolCreateInfo{}
+          .setQueryType(vk::QueryType::eTimestamp)
+          .setQueryCount(kMaxBatches * kMaxScopesPerBatch * 2));
+  for (auto &batch : _batches) {
+    batch.scopes.resize(kMaxScopesPerBatch);
+  }
+}
+
+GpuProfiler::BatchId GpuProfiler::beginBatch(vk::CommandBuffer cmd) {
+  if (!enabled()) {
+    return kNoBatch;
+  }
+  std::scoped_lock lock{_mutex};
+  auto batchId = _nextBatch;
+  auto &batch = _batches[batchId];
+  if (batch.state == Batch::State::eSubmitted &&
+      batch.timeline->reached(batch.value)) {
+    read(batchId);
+  }
+  if (batch.state != Batch::State::eFree) {
+    _droppedBatches++;
+    return kNoBatch;
+  }
+  _nextBatch = (batchId + 1) % kMaxBatches;
+  batch.state = Batch::State::eRecording;
+  batch.scopeCount.store(0, std::memory_order_relaxed);
+  cmd.resetQueryPool(_queryPool.get(), firstQuery(batchId),
+                     kMaxScopesPerBatch * 2);
+  return batchId;
+}
+
+void GpuProfiler::submitted(BatchId batchId, const Timeline &timeline,
+                            uint64_t value) {
+  if (batchId == kNoBatch) {
+    return;
+  }
+  std::scoped_lock lock{_mutex};
+  auto &batch = _batches[batchId];
+  batch.state = Batch::State::eSubmitted;
+  batch.timeline = &timeline;
+  batch.value = value;
+  batch.submitTime = Clock::now();
+}
+
+GpuProfiler::ScopeId GpuProfiler::begin(BatchId batchId, vk::CommandBuffer cmd,
+                                        std::string_view name,
+                                        ScopeId parent) {
+  if (batchId == kNoBatch) {
+    return kNoScope;
+  }
+  auto &batch = _batches[batchId];
+  auto scope = batch.scopeCount.fetch_add(1, std::memory_order_relaxed);
+  if (scope >= kMaxScopesPerBatch) {
+    return kNoScope;
+  }
+  batch.scopes[scope].name = name;
+  batch.scopes[scope].parent = parent;
+  cmd.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, _queryPool.get(),
+                     firstQuery(batchId) + scope * 2);
+  return scope;
+}
+
+void GpuProfiler::end(BatchId batchId, vk::CommandBuffer cmd, ScopeId scope) {
+  if (batchId == kNoBatch || scope == kNoScope) {
+    return;
+  }
+  cmd.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe,
+                     _queryPool.get(), firstQuery(batchId) + scope * 2 + 1);
+}
+
+void GpuProfiler::collect() {
+  std::scoped_lock lock{_mutex};
+  // Batches mostly share a couple of timelines, each queried once.
+  std::vector<std::pair<const Timeline *, uint64_t>> completedValues;
+  auto completedValue = [&](const Timeline &timeline) {
+    auto it = std::ranges::find(completedValues, &timeline,
+                                &std::pair<const Timeline *, uint64_t>::first);
+    if (it == completedValues.end()) {
+      completedValues.emplace_back(&timeline, timeline.completedValue());
+      return completedValues.back().second;
+    }
+    return it->second;
+  };
+  for (BatchId batchId = 0; batchId < kMaxBatches; batchId++) {
+    const auto &batch = _batches[batchId];
+    if (batch.state == Batch::State::eSubmitted &&
+        completedValue(*batch.timeline) >= batch.value) {
+      read(batchId);
+    }
+  }
+}
+
+std::vector<GpuProfiler::ScopeStats> GpuProfiler::stats() {
+  std::scoped_lock lock{_mutex};
+  return _stats;
+}
+
+uint64_t GpuProfiler::droppedBatches() {
+  std::scoped_lock lock{_mutex};
+  return _droppedBatches;
+}
+
+void GpuProfiler::read(BatchId batchId) {
+  auto &batch = _batches[batchId];
+  batch.state = Batch::State::eFree;
+  auto scopeCount = std::min(batch.scopeCount.load(std::memory_order_relaxed),
+                             kMaxScopesPerBatch);
+  if (scopeCount == 0) {
+    return;
+  }
+  // Not ready only when a scope was never ended, in which case the batch is
+  // dropped.
+  auto result = _device.getQueryPoolResults(
+      _queryPool.get(), firstQuery(batchId), scopeCount * 2,
+      scopeCount * 2 * sizeof(uint64_t), _timestamps.data(), sizeof(uint64_t),
+      vk::QueryResultFlagBits::e64);
+  if (result != vk::Result::eSuccess) {
+    return;
+  }
+
+  // GPU and host time at the same instant, to place GPU timestamps on the
+  // host clock.
+  std::optional<std::pair<uint64_t, Clock::time_point>> calibration;
+  if (_getCalibratedTimestamps) {
+    auto infos = std::to_array({
+        vk::CalibratedTimestampInfoEXT{vk::TimeDomainEXT::eDevice},
+        vk::CalibratedTimestampInfoEXT{*kHostTimeDomain},
+    });
+    std::array<uint64_t, 2> values;
+    uint64_t maxDeviation;
+    auto calibrationResult = _getCalibratedTimestamps(
+        _device, static_cast<uint32_t>(infos.size()),
+        reinterpret_cast<const VkCalibratedTimestampInfoEXT *>(infos.data()),
+        values.data(), &maxDeviation);
+    if (calibrationResult == VK_SUCCESS) {
+      calibration = std::pair{values[0],
+                              Clock::time_point{std::chrono::nanoseconds{
+                                  static_cast<int64_t>(values[1])}}};
+    }
+  }
+
+  _paths.resize(scopeCount);
+  _durations.assign(_stats.size(), Duration{});
+  _recorded.clear();
+  for (ScopeId scope = 0; scope < scopeCount; scope++) {
+    const auto &record = batch.scopes[scope];
+    auto begin = _timestamps[scope * 2];
+    auto end = _timestamps[scope * 2 + 1];
+    Duration duration = std::chrono::duration<double, std::nano>(
+        static_cast<double>((end - begin) & _timestampMask) *
+        _timestampPeriod);
+
+    // Parents are always begun, and so numbered, before their children.
+    _paths[scope] = record.parent == kNoScope
+                        ? record.name
+                        : _paths[record.parent] + "/" + record.name;
+    auto [it, inserted] =
+        _statIndices.try_emplace(_paths[scope], _stats.size());
+    if (inserted) {
+      auto depth =
+          static_cast<uint32_t>(std::ranges::count(_paths[scope], '/'));
+      _stats.push_back({_paths[scope], depth, 0, {}, {}, std::nullopt});
+      _durations.push_back({});
+    }
+    auto index = it->second;
+    if (!std::ranges::contains(_recorded, index)) {
+      _recorded.push_back(index);
+    }
+    _durations[index] += duration;
+
+    if (calibration.has_value() && record.parent == kNoScope) {
+      auto [gpuNow, hostNow] = *calibration;
+      auto ticks = static_cast<double>(begin) - static_cast<double>(gpuNow);
+      auto gpuBegin =
+          hostNow + std::chrono::duration_cast<Clock::duration>(
+                        std::chrono::duration<double, std::nano>(
+                            ticks * _timestampPeriod));
+      auto &stats = _stats[index];
+      stats.totalQueueDelay =
+          stats.totalQueueDelay.value_or(Duration{}) +
+          Duration{gpuBegin - batch.submitTime};
+    }
+  }
+  for (auto index : _recorded) {
+    auto &stats = _stats[index];
+    stats.count++;
+    stats.total += _durations[index];
+    stats.max = std::max(stats.max, _durations[index]);
+  }
+}
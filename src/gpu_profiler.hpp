@@ -0,0 +1,145 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+struct Timeline;
+
+// Host clock `steady_clock` reads, which GPU timestamps can be calibrated
+// against with `VK_EXT_calibrated_timestamps`. Only known on Linux.
+#ifdef __linux__
+inline constexpr std::optional<vk::TimeDomainEXT> kHostTimeDomain =
+    vk::TimeDomainEXT::eClockMonotonic;
+#else
+inline constexpr std::optional<vk::TimeDomainEXT> kHostTimeDomain =
+    std::nullopt;
+#endif
+
+// Measures the GPU time of named scopes with timestamp queries. Scopes are
+// recorded into batches, one per submission (e.g. a frame or an upload), and
+// nest by naming their parent. Once the timeline a batch was submitted on
+// reaches it, `collect` reads its queries back without waiting and folds them
+// into per-scope statistics, so results lag a few frames behind.
+//
+// Disabled by default, in which case batches and scopes are never started and
+// recording them costs a branch. Scopes of a batch may be recorded from
+// several threads (e.g. into secondary command buffers); starting, submitting
+// and collecting batches is synchronized as well.
+struct GpuProfiler {
+  using Clock = std::chrono::steady_clock;
+  using Duration = std::chrono::duration<double, std::milli>;
+  using BatchId = uint32_t;
+  using ScopeId = uint32_t;
+
+  static constexpr BatchId kNoBatch = std::numeric_limits<BatchId>::max();
+  static constexpr ScopeId kNoScope = std::numeric_limits<ScopeId>::max();
+  static constexpr uint32_t kMaxBatches = 64;
+  static constexpr uint32_t kMaxScopesPerBatch = 128;
+
+  struct ScopeStats {
+    // Scope names from the root down, separated by '/'
+    std::string path;
+    uint32_t depth;
+    // Batches the scope was recorded in. Scopes recorded several times in a
+    // batch (e.g. a material drawn from several slices) add up.
+    uint64_t count;
+    Duration total;
+    Duration max;
+    // For root scopes, when timestamps are calibrated: time from submitting
+    // the batch to the GPU starting the scope, summed over batches.
+    std::optional<Duration> totalQueueDelay;
+  };
+
+  // `calibrated` tells whether `VK_EXT_calibrated_timestamps` is enabled on
+  // `device` with `kHostTimeDomain`. Timestamps are written on queues of
+  // `queueFamily`.
+  GpuProfiler(vk::Device device, vk::PhysicalDevice physicalDevice,
+              uint32_t queueFamily, bool calibrated);
+  GpuProfiler(const GpuProfiler &) = delete;
+  GpuProfiler &operator=(const GpuProfiler &) = delete;
+
+  // Whether the queue family writes timestamps at all.
+  inline bool supported() const { return _timestampMask != 0; }
+  inline bool calibrated() const { return _getCalibratedTimestamps; }
+  inline bool enabled() const {
+    return _enabled.load(std::memory_order_relaxed);
+  }
+  // Ignored unless `supported`.
+  inline void setEnabled(bool enabled) {
+    _enabled.store(enabled && supported(), std::memory_order_relaxed);
+  }
+
+  // Starts a batch recorded into `cmd`, which must be outside of any render
+  // pass. Returns `kNoBatch` when disabled, or when every batch is still in
+  // flight, in which case the batch is counted as dropped.
+  BatchId beginBatch(vk::CommandBuffer cmd);
+  // Must be called once the command buffers of `batch` are submitted, with
+  // the value they signal on `timeline`.
+  void submitted(BatchId batch, const Timeline &timeline, uint64_t value);
+  // Returns `kNoScope`, and records nothing, when `batch` is `kNoBatch` or
+  // out of scopes. `name` is copied.
+  ScopeId begin(BatchId batch, vk::CommandBuffer cmd, std::string_view name,
+                ScopeId parent = kNoScope);
+  void end(BatchId batch, vk::CommandBuffer cmd, ScopeId scope);
+  // Reads back the batches the GPU is done with. Cheap enough to call every
+  // frame.
+  void collect();
+
+  // In order of first appearance, so children follow their parents.
+  std::vector<ScopeStats> stats();
+  uint64_t droppedBatches();
+
+private:
+  struct ScopeRecord {
+    std::string name;
+    ScopeId parent;
+  };
+  struct Batch {
+    enum class State { eFree, eRecording, eSubmitted };
+
+    State state = State::eFree;
+    const Timeline *timeline = nullptr;
+    uint64_t value = 0;
+    Clock::time_point submitTime;
+    std::atomic<uint32_t> scopeCount = 0;
+    std::vector<ScopeRecord> scopes;
+  };
+
+  inline uint32_t firstQuery(BatchId batch) const {
+    return batch * kMaxScopesPerBatch * 2;
+  }
+  // Must be called with the lock held.
+  void read(BatchId batch);
+
+  vk::Device _device;
+  vk::UniqueQueryPool _queryPool;
+  // Nanoseconds per timestamp tick
+  double _timestampPeriod;
+  // Bits of timestamps that are valid, none when unsupported
+  uint64_t _timestampMask;
+  // Null unless calibrated
+  PFN_vkGetCalibratedTimestampsEXT _getCalibratedTimestamps;
+  std::atomic<bool> _enabled = false;
+  std::mutex _mutex;
+  std::vector<Batch> _batches;
+  BatchId _nextBatch = 0;
+  uint64_t _droppedBatches = 0;
+  std::vector<uint64_t> _timestamps;
+  std::vector<ScopeStats> _stats;
+  std::unordered_map<std::string, size_t> _statIndices;
+  // Scratch space for `read`: paths of the batch's scopes, durations per
+  // stats entry, and the entries the batch recorded.
+  std::vector<std::string> _paths;
+  std::vector<Duration> _durations;
+  std::vector<size_t> _recorded;
+};
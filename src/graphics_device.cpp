@@ -1,9 +1,14 @@
 #define VMA_IMPLEMENTATION
 #include "graphics_device.hpp"
 
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
 #include <print>
 #include <ranges>
 #include <string>
+#include <vector>
 
 #include <vulkan/vulkan.hpp>
 
@@ -14,29 +19,52 @@ namespace views = std::ranges::views;
 const auto kEngineName = "Glock Engine";
 const auto kEngineVersion = VK_MAKE_VERSION(0, 1, 0);
 
-const auto kVkLayers = std::to_array({"VK_LAYER_KHRONOS_validation"});
+const auto kVkValidationLayer = "VK_LAYER_KHRONOS_validation";
 const auto kVkDeviceExtensions = std::to_array({vk::KHRSwapchainExtensionName});
+const std::array<const char *, 0> kVkHeadlessDeviceExtensions{};
+// Optional, enabled along with the swapchain when supported.
+const auto kVkPresentWaitExtensions = std::to_array(
+    {vk::KHRPresentIdExtensionName, vk::KHRPresentWaitExtensionName});
+// Optional, enabled when supported.
+const auto kVkCalibratedTimestampsExtensions =
+    std::to_array({vk::EXTCalibratedTimestampsExtensionName});
 const auto kDepthFormatCandidates = {vk::Format::eD32Sfloat,
                                      vk::Format::eD32SfloatS8Uint,
                                      vk::Format::eD24UnormS8Uint};
 
+// Whether the instance layer `name` is installed.
+bool hasInstanceLayer(std::string_view name) {
+  auto layers = vk::enumerateInstanceLayerProperties();
+  return std::ranges::any_of(layers, [&](const vk::LayerProperties &layer) {
+    return name == layer.layerName.data();
+  });
+}
+
 vk::UniqueInstance createInstance(std::string_view appName,
-                                  AppVersion appVersion) {
+                                  AppVersion appVersion,
+                                  std::span<const char *const> extensions,
+                                  bool validation) {
+  std::vector<const char *> layers;
+  if (validation) {
+    if (hasInstanceLayer(kVkValidationLayer)) {
+      layers.push_back(kVkValidationLayer);
+    } else {
+      std::println("Validation unavailable: {} is not installed",
+                   kVkValidationLayer);
+    }
+  }
   std::string appNameOwned = std::string(appName);
   vk::ApplicationInfo kApplicationInfo = {
       appNameOwned.c_str(), appVersion,       kEngineName,
       kEngineVersion,       vk::ApiVersion13,
   };
-  uint32_t vkInstanceExtensionCount;
-  const char **vkInstanceExtensions =
-      glfwGetRequiredInstanceExtensions(&vkInstanceExtensionCount);
   return vk::createInstanceUnique(vk::InstanceCreateInfo{
       {},
       &kApplicationInfo,
-      kVkLayers.size(),
-      kVkLayers.data(),
-      vkInstanceExtensionCount,
-      vkInstanceExtensions,
+      static_cast<uint32_t>(layers.size()),
+      layers.data(),
+      static_cast<uint32_t>(extensions.size()),
+      extensions.data(),
   });
 }
 
@@ -68,15 +96,37 @@ void logPhysicalDevicesInfo(std::span<vk::PhysicalDevice> physicalDevices) {
   }
 }
 
-std::tuple<vk::PhysicalDevice, std::array<QueueIndex, 2>, uint32_t>
+// A family with transfer but neither graphics nor compute support, usually
+// backed by a DMA engine that runs copies alongside rendering.
+std::optional<QueueIndex>
+findTransferFamily(std::span<const vk::QueueFamilyProperties> queueFamilies) {
+  for (auto [i, queueFamily] : queueFamilies | views::enumerate) {
+    auto flags = queueFamily.queueFlags;
+    auto generalFlags =
+        vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute;
+    if (flags & vk::QueueFlagBits::eTransfer && !(flags & generalFlags)) {
+      return static_cast<QueueIndex>(i);
+    }
+  }
+  return std::nullopt;
+}
+
+// Also returns the family uploads are submitted to: a dedicated transfer
+// family when there is one, the graphics family otherwise.
+std::tuple<vk::PhysicalDevice, std::array<QueueIndex, 2>, uint32_t, QueueIndex>
 autoselectPhysicalDevice(std::span<vk::PhysicalDevice> physicalDevices,
-                         const vk::SurfaceKHR surface) {
+                         const vk::SurfaceKHR surface,
+                         std::span<const char *const> deviceExtensions) {
   std::optional<vk::PhysicalDevice> selectedDevice;
   std::array<uint32_t, 2> queueFamilies;
   uint32_t queueFamilyCount;
+  QueueIndex workQueueFamily;
   for (auto [i, device] : physicalDevices | views::enumerate) {
-    // 1. Needs a Graphics queue and a Present queue;
-    // 2. Needs to support all required device extensions
+    // 1. Needs a Graphics queue and a Present queue (the latter only when
+    //    there is a surface to present to);
+    // 2. Needs to support all required device extensions;
+    // 3. Needs Vulkan 1.3 dynamic rendering, the descriptor indexing
+    //    features used by the `BindlessHeap`, and timeline semaphores.
     auto extensions = device.enumerateDeviceExtensionProperties();
     auto allQueueFamilies = device.getQueueFamilyProperties();
 
@@ -88,8 +138,11 @@ autoselectPhysicalDevice(std::span<vk::PhysicalDevice> physicalDevices,
         graphicsQueue = index;
       }
 
-      if ((!presentQueue.has_value() || presentQueue == graphicsQueue) &&
-          device.getSurfaceSupportKHR(index, surface)) {
+      if (!surface) {
+        presentQueue = graphicsQueue;
+      } else if ((!presentQueue.has_value() ||
+                  presentQueue == graphicsQueue) &&
+                 device.getSurfaceSupportKHR(index, surface)) {
         presentQueue = index;
       }
       if (graphicsQueue.has_value() && presentQueue.has_value()) {
@@ -104,54 +157,219 @@ autoselectPhysicalDevice(std::span<vk::PhysicalDevice> physicalDevices,
             extensions | std::ranges::views::transform([](auto extension) {
               return std::string_view{extension.extensionName};
             }),
-            kVkDeviceExtensions |
+            deviceExtensions |
                 std::ranges::views::transform([](auto extensionName) {
                   return std::string_view{extensionName};
                 }))) {
       continue;
     };
 
+    auto features = device.getFeatures2<vk::PhysicalDeviceFeatures2,
+                                        vk::PhysicalDeviceVulkan12Features,
+                                        vk::PhysicalDeviceVulkan13Features>();
+    const auto &vulkan12Features =
+        features.get<vk::PhysicalDeviceVulkan12Features>();
+    if (device.getProperties().apiVersion < vk::ApiVersion13 ||
+        !features.get<vk::PhysicalDeviceVulkan13Features>().dynamicRendering ||
+        !vulkan12Features.runtimeDescriptorArray ||
+        !vulkan12Features.descriptorBindingPartiallyBound ||
+        !vulkan12Features.descriptorBindingSampledImageUpdateAfterBind ||
+        !vulkan12Features.descriptorBindingStorageBufferUpdateAfterBind ||
+        !vulkan12Features.shaderSampledImageArrayNonUniformIndexing ||
+        !vulkan12Features.timelineSemaphore) {
+      continue;
+    }
+
     selectedDevice = device;
     queueFamilies = {*graphicsQueue, *presentQueue};
     queueFamilyCount = graphicsQueue == presentQueue ? 1 : 2;
+    workQueueFamily =
+        findTransferFamily(allQueueFamilies).value_or(*graphicsQueue);
     break;
   }
   if (!selectedDevice.has_value()) {
     throw std::runtime_error(std::format("no suitable Vulkan device found"));
   }
-  return std::make_tuple(*selectedDevice, queueFamilies, queueFamilyCount);
+  return std::make_tuple(*selectedDevice, queueFamilies, queueFamilyCount,
+                         workQueueFamily);
+}
+
+bool supportsExtensions(vk::PhysicalDevice physicalDevice,
+                        std::span<const char *const> extensionNames) {
+  auto extensions = physicalDevice.enumerateDeviceExtensionProperties();
+  return std::ranges::all_of(
+      extensionNames, [&](std::string_view extensionName) {
+        return std::ranges::contains(
+            extensions | views::transform([](auto extension) {
+              return std::string_view{extension.extensionName};
+            }),
+            extensionName);
+      });
+}
+
+bool supportsPresentWait(vk::PhysicalDevice physicalDevice) {
+  if (!supportsExtensions(physicalDevice, kVkPresentWaitExtensions)) {
+    return false;
+  }
+  auto features =
+      physicalDevice.getFeatures2<vk::PhysicalDeviceFeatures2,
+                                  vk::PhysicalDevicePresentIdFeaturesKHR,
+                                  vk::PhysicalDevicePresentWaitFeaturesKHR>();
+  return features.get<vk::PhysicalDevicePresentIdFeaturesKHR>().presentId &&
+         features.get<vk::PhysicalDevicePresentWaitFeaturesKHR>().presentWait;
 }
 
-std::tuple<vk::UniqueDevice, vk::Queue, vk::Queue>
+// Whether the device can sample its timestamps together with the clock
+// `steady_clock` reads.
+bool supportsCalibratedTimestamps(vk::Instance instance,
+                                  vk::PhysicalDevice physicalDevice) {
+  if (!kHostTimeDomain.has_value() ||
+      !supportsExtensions(physicalDevice, kVkCalibratedTimestampsExtensions)) {
+    return false;
+  }
+  // Not part of the static dispatcher, since the extension is optional.
+  auto getTimeDomains =
+      reinterpret_cast<PFN_vkGetPhysicalDeviceCalibrateableTimeDomainsEXT>(
+          instance.getProcAddr(
+              "vkGetPhysicalDeviceCalibrateableTimeDomainsEXT"));
+  uint32_t count = 0;
+  if (!getTimeDomains ||
+      getTimeDomains(physicalDevice, &count, nullptr) != VK_SUCCESS) {
+    return false;
+  }
+  std::vector<vk::TimeDomainEXT> domains(count);
+  if (getTimeDomains(physicalDevice, &count,
+                     reinterpret_cast<VkTimeDomainEXT *>(domains.data())) !=
+      VK_SUCCESS) {
+    return false;
+  }
+  return std::ranges::contains(domains, vk::TimeDomainEXT::eDevice) &&
+         std::ranges::contains(domains, *kHostTimeDomain);
+}
+
+// Enables the optional features the renderer can take advantage of, when
+// supported.
+vk::PhysicalDeviceFeatures selectFeatures(vk::PhysicalDevice physicalDevice) {
+  auto supported = physicalDevice.getFeatures();
+  return vk::PhysicalDeviceFeatures{}
+      .setMultiDrawIndirect(supported.multiDrawIndirect)
+      .setDrawIndirectFirstInstance(supported.drawIndirectFirstInstance)
+      .setPipelineStatisticsQuery(supported.pipelineStatisticsQuery);
+}
+
+std::tuple<vk::UniqueDevice, vk::Queue, vk::Queue, vk::Queue>
 createDevice(vk::PhysicalDevice physicalDevice,
              std::array<QueueIndex, 2> queueFamilies,
-             uint32_t queueFamilyCount) {
+             QueueIndex workQueueFamily,
+             const vk::PhysicalDeviceFeatures &features,
+             std::span<const char *const> deviceExtensions, bool presentWait) {
   float queuePriority = 0.0f;
-  auto queueInfos = std::to_array({
-      vk::DeviceQueueCreateInfo({}, queueFamilies[0], 1, &queuePriority),
-      vk::DeviceQueueCreateInfo({}, queueFamilies[1], 1, &queuePriority),
-  });
+  std::vector<vk::DeviceQueueCreateInfo> queueInfos;
+  for (auto family : {queueFamilies[0], queueFamilies[1], workQueueFamily}) {
+    if (!std::ranges::contains(queueInfos, family,
+                               &vk::DeviceQueueCreateInfo::queueFamilyIndex)) {
+      queueInfos.push_back(
+          vk::DeviceQueueCreateInfo({}, family, 1, &queuePriority));
+    }
+  }
+  auto presentWaitFeatures =
+      vk::PhysicalDevicePresentWaitFeaturesKHR{}.setPresentWait(true);
+  auto presentIdFeatures = vk::PhysicalDevicePresentIdFeaturesKHR{}
+                               .setPNext(&presentWaitFeatures)
+                               .setPresentId(true);
+  auto vulkan13Features =
+      vk::PhysicalDeviceVulkan13Features{}
+          .setPNext(presentWait ? &presentIdFeatures : nullptr)
+          .setDynamicRendering(true);
+  auto vulkan12Features =
+      vk::PhysicalDeviceVulkan12Features{}
+          .setPNext(&vulkan13Features)
+          .setRuntimeDescriptorArray(true)
+          .setDescriptorBindingPartiallyBound(true)
+          .setDescriptorBindingSampledImageUpdateAfterBind(true)
+          .setDescriptorBindingStorageBufferUpdateAfterBind(true)
+          .setShaderSampledImageArrayNonUniformIndexing(true)
+          .setTimelineSemaphore(true);
+  // Device layers are deprecated: those of the instance apply.
   auto device = physicalDevice.createDeviceUnique(
       vk::DeviceCreateInfo{}
-          .setPQueueCreateInfos(queueInfos.data())
-          .setQueueCreateInfoCount(queueFamilyCount)
-          .setPEnabledLayerNames(kVkLayers)
-          .setPEnabledExtensionNames(kVkDeviceExtensions));
+          .setPNext(&vulkan12Features)
+          .setQueueCreateInfos(queueInfos)
+          .setPEnabledExtensionNames(deviceExtensions)
+          .setPEnabledFeatures(&features));
   auto graphicsQueue = device->getQueue(queueFamilies[0], 0);
   auto presentQueue = device->getQueue(queueFamilies[1], 0);
-  return std::make_tuple(std::move(device), graphicsQueue, presentQueue);
+  auto workQueue = device->getQueue(workQueueFamily, 0);
+  return std::make_tuple(std::move(device), graphicsQueue, presentQueue,
+                         workQueue);
 }
 
-GraphicsDevice GraphicsDevice::createFor(const Window &window,
-                                         std::string_view appName,
-                                         AppVersion appVersion) {
-  auto instance = createInstance(appName, appVersion);
+std::string
+pipelineCachePathFor(const vk::PhysicalDeviceProperties &properties) {
+  return std::format("./pipeline_cache-{:04x}-{:04x}.bin", properties.vendorID,
+                     properties.deviceID);
+}
+
+// Whether `data` starts with a cache header written by the same device and
+// driver, which `vkCreatePipelineCache` would otherwise silently discard (or,
+// on some drivers, choke on).
+bool isPipelineCacheCompatible(std::span<const char> data,
+                               const vk::PhysicalDeviceProperties &properties) {
+  VkPipelineCacheHeaderVersionOne header;
+  if (data.size() < sizeof(header)) {
+    return false;
+  }
+  std::memcpy(&header, data.data(), sizeof(header));
+  return header.headerSize >= sizeof(header) &&
+         header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+         header.vendorID == properties.vendorID &&
+         header.deviceID == properties.deviceID &&
+         std::ranges::equal(header.pipelineCacheUUID,
+                            properties.pipelineCacheUUID);
+}
+
+// Creates the pipeline cache, seeded with the file at `path` when it exists
+// and is compatible. Returns whether it was.
+std::tuple<vk::UniquePipelineCache, bool>
+loadPipelineCache(vk::Device device,
+                  const vk::PhysicalDeviceProperties &properties,
+                  const std::string &path) {
+  std::vector<char> data;
+  std::ifstream file(path, std::ios::binary);
+  if (file.is_open()) {
+    data = std::vector<char>{std::istreambuf_iterator(file), {}};
+  }
+  if (!isPipelineCacheCompatible(data, properties)) {
+    data.clear();
+  }
+  auto cache = device.createPipelineCacheUnique(
+      vk::PipelineCacheCreateInfo{}
+          .setInitialDataSize(data.size())
+          .setPInitialData(data.data()));
+  return std::make_tuple(std::move(cache), !data.empty());
+}
+
+GraphicsDevice
+createGraphicsDevice(vk::UniqueInstance instance, vk::UniqueSurfaceKHR surface,
+                     std::span<const char *const> deviceExtensions) {
   auto physicalDevices = instance->enumeratePhysicalDevices();
-  auto surface = createSurface(*instance, window.glfwWindow());
-  auto [physicalDevice, queueFamilies, queueFamilyCount] =
-      autoselectPhysicalDevice(physicalDevices, *surface);
-  auto [device, graphicsQueue, presentQueue] =
-      createDevice(physicalDevice, queueFamilies, queueFamilyCount);
+  auto [physicalDevice, queueFamilies, queueFamilyCount, workQueueFamily] =
+      autoselectPhysicalDevice(physicalDevices, *surface, deviceExtensions);
+  auto features = selectFeatures(physicalDevice);
+  auto presentWait = surface && supportsPresentWait(physicalDevice);
+  std::vector<const char *> enabledExtensions(deviceExtensions.begin(),
+                                              deviceExtensions.end());
+  if (presentWait) {
+    enabledExtensions.append_range(kVkPresentWaitExtensions);
+  }
+  auto calibratedTimestamps =
+      supportsCalibratedTimestamps(*instance, physicalDevice);
+  if (calibratedTimestamps) {
+    enabledExtensions.append_range(kVkCalibratedTimestampsExtensions);
+  }
+  auto [device, graphicsQueue, presentQueue, workQueue] =
+      createDevice(physicalDevice, queueFamilies, workQueueFamily, features,
+                   enabledExtensions, presentWait);
   auto depthFormat = std::ranges::find_if(
       kDepthFormatCandidates, [&](const vk::Format &format) {
         auto formatProperties = physicalDevice.getFormatProperties(format);
@@ -159,7 +377,6 @@ GraphicsDevice GraphicsDevice::createFor(const Window &window,
                 vk::FormatFeatureFlagBits::eDepthStencilAttachment) ==
                vk::FormatFeatureFlagBits::eDepthStencilAttachment;
       });
-  auto workQueue = graphicsQueue;
   auto allocator =
       vma::createAllocatorUnique(vma::AllocatorCreateInfo{}
                                      .setDevice(*device)
@@ -169,16 +386,104 @@ GraphicsDevice GraphicsDevice::createFor(const Window &window,
   auto workCommandPool = device->createCommandPoolUnique(
       vk::CommandPoolCreateInfo{}
           .setFlags(vk::CommandPoolCreateFlagBits::eTransient)
-          .setQueueFamilyIndex(queueFamilies[1]));
-  return {std::move(instance),  std::move(surface),
-          physicalDevice,       std::move(device),
-          *depthFormat,         queueFamilies,
-          queueFamilyCount,     workQueue,
-          graphicsQueue,        presentQueue,
-          std::move(allocator), std::move(workCommandPool)};
+          .setQueueFamilyIndex(workQueueFamily));
+  auto acquireCommandPool = device->createCommandPoolUnique(
+      vk::CommandPoolCreateInfo{}
+          .setFlags(vk::CommandPoolCreateFlagBits::eTransient)
+          .setQueueFamilyIndex(queueFamilies[0]));
+  auto properties = physicalDevice.getProperties();
+  auto pipelineCachePath = pipelineCachePathFor(properties);
+  auto [pipelineCache, pipelineCacheWarm] =
+      loadPipelineCache(*device, properties, pipelineCachePath);
+  return {std::move(instance),
+          std::move(surface),
+          physicalDevice,
+          std::move(device),
+          features,
+          *depthFormat,
+          queueFamilies,
+          queueFamilyCount,
+          workQueueFamily,
+          workQueue,
+          graphicsQueue,
+          presentQueue,
+          std::move(allocator),
+          std::move(workCommandPool),
+          std::move(acquireCommandPool),
+          std::move(pipelineCache),
+          std::move(pipelineCachePath),
+          pipelineCacheWarm,
+          presentWait,
+          calibratedTimestamps};
+}
+
+GraphicsDevice GraphicsDevice::createFor(const Window &window,
+                                         std::string_view appName,
+                                         AppVersion appVersion,
+                                         bool validation) {
+  uint32_t vkInstanceExtensionCount;
+  const char **vkInstanceExtensions =
+      glfwGetRequiredInstanceExtensions(&vkInstanceExtensionCount);
+  auto instance = createInstance(
+      appName, appVersion, {vkInstanceExtensions, vkInstanceExtensionCount},
+      validation);
+  auto surface = createSurface(*instance, window.glfwWindow());
+  return createGraphicsDevice(std::move(instance), std::move(surface),
+                              kVkDeviceExtensions);
+}
+
+GraphicsDevice GraphicsDevice::createHeadless(std::string_view appName,
+                                              AppVersion appVersion,
+                                              bool validation) {
+  auto instance = createInstance(appName, appVersion, {}, validation);
+  return createGraphicsDevice(std::move(instance), vk::UniqueSurfaceKHR{},
+                              kVkHeadlessDeviceExtensions);
 }
 
 void GraphicsDevice::waitIdle() const { _vkDevice->waitIdle(); }
+
+uint64_t
+GraphicsDevice::submitGraphics(const vk::SubmitInfo &submitInfo) const {
+  auto handoff = _uploads->handOff();
+  auto uploads = std::to_array(
+      {TimelineWait{_uploadTimeline->vkSemaphore(), handoff.uploads.value,
+                    vk::PipelineStageFlagBits::eAllCommands}});
+  if (!handoff.acquire) {
+    return _graphicsTimeline->submit(_graphicsQueue, submitInfo, uploads);
+  }
+  // Images are acquired ahead of the work using them, in the same
+  // submission.
+  std::vector<vk::CommandBuffer> commandBuffers{handoff.acquire.get()};
+  commandBuffers.insert(commandBuffers.end(), submitInfo.pCommandBuffers,
+                        submitInfo.pCommandBuffers +
+                            submitInfo.commandBufferCount);
+  auto value = _graphicsTimeline->submit(
+      _graphicsQueue,
+      vk::SubmitInfo{submitInfo}.setCommandBuffers(commandBuffers), uploads);
+  retire(std::move(handoff.acquire));
+  return value;
+}
+
+void GraphicsDevice::collectRetired() const {
+  _retired->collect(_graphicsTimeline->completedValue());
+  _retiredUploads->collect(_uploadTimeline->completedValue());
+}
+void GraphicsDevice::savePipelineCache() const {
+  auto data = _vkDevice->getPipelineCacheData(_pipelineCache.get());
+  // Written next to the destination first, so a crash halfway through never
+  // leaves a truncated cache behind.
+  auto tempPath = _pipelineCachePath + ".tmp";
+  {
+    std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char *>(data.data()),
+               static_cast<std::streamsize>(data.size()));
+    if (!file) {
+      throw std::runtime_error(
+          std::format("failed to write pipeline cache {}", tempPath));
+    }
+  }
+  std::filesystem::rename(tempPath, _pipelineCachePath);
+}
 vk::UniqueCommandPool GraphicsDevice::createGraphicsCommandPool(
     vk::CommandPoolCreateFlags flags) const {
   return _vkDevice->createCommandPoolUnique({flags, graphicsQueueIndex()});
@@ -1,9 +1,18 @@
 #pragma once
 
+#include <memory>
+#include <string>
+
 #include <vulkan/vulkan.hpp>
 
 #include <vk_mem_alloc.hpp>
 
+#include "deletion_queue.hpp"
+#include "gpu_profiler.hpp"
+#include "pipeline_registry.hpp"
+#include "upload_queue.hpp"
+#include "timeline.hpp"
+
 #define MAKE_VERSION(major, minor, patch) VK_MAKE_VERSION(major, minor, patch)
 
 using AppVersion = uint32_t;
@@ -15,58 +24,172 @@ struct Window;
 struct GraphicsDevice {
   GraphicsDevice(vk::UniqueInstance vkInstance, vk::UniqueSurfaceKHR vkSurface,
                  vk::PhysicalDevice vkPhysicalDevice, vk::UniqueDevice vkDevice,
-                 vk::Format depthFormat,
+                 vk::PhysicalDeviceFeatures features, vk::Format depthFormat,
                  std::array<QueueIndex, 2> queueFamilies,
-                 uint32_t queueFamilyCount, vk::Queue workQueue,
-                 vk::Queue graphicsQueue, vk::Queue presentQueue,
-                 vma::UniqueAllocator vmaAllocator,
-                 vk::UniqueCommandPool workCommandPool)
+                 uint32_t queueFamilyCount, QueueIndex workQueueFamily,
+                 vk::Queue workQueue, vk::Queue graphicsQueue,
+                 vk::Queue presentQueue, vma::UniqueAllocator vmaAllocator,
+                 vk::UniqueCommandPool workCommandPool,
+                 vk::UniqueCommandPool acquireCommandPool,
+                 vk::UniquePipelineCache pipelineCache,
+                 std::string pipelineCachePath, bool pipelineCacheWarm,
+                 bool presentWait, bool calibratedTimestamps)
       : _vkInstance(std::move(vkInstance)), _vkSurface(std::move(vkSurface)),
         _vkPhysicalDevice(vkPhysicalDevice), _vkDevice(std::move(vkDevice)),
-        _depthFormat(depthFormat), _queueFamilies(queueFamilies),
-        _queueFamilyCount(queueFamilyCount), _workQueue(workQueue),
-        _graphicsQueue(graphicsQueue), _presentQueue(presentQueue),
-        _vmaAllocator(std::move(vmaAllocator)),
-        _workCommandPool(std::move(workCommandPool)) {}
+        _features(features), _depthFormat(depthFormat),
+        _queueFamilies(queueFamilies),
+        _queueFamilyCount(queueFamilyCount),
+        _bufferQueueFamilies{queueFamilies[0], workQueueFamily},
+        _workQueue(workQueue), _graphicsQueue(graphicsQueue),
+        _presentQueue(presentQueue), _vmaAllocator(std::move(vmaAllocator)),
+        _workCommandPool(std::move(workCommandPool)),
+        _acquireCommandPool(std::move(acquireCommandPool)),
+        _pipelineCache(std::move(pipelineCache)),
+        _pipelineCachePath(std::move(pipelineCachePath)),
+        _pipelineCacheWarm(pipelineCacheWarm), _presentWait(presentWait),
+        _graphicsTimeline(std::make_unique<Timeline>(_vkDevice.get())),
+        _uploadTimeline(std::make_unique<Timeline>(_vkDevice.get())),
+        _retired(std::make_unique<DeletionQueue>()),
+        _retiredUploads(std::make_unique<DeletionQueue>()),
+        _gpuProfiler(std::make_unique<GpuProfiler>(
+            _vkDevice.get(), _vkPhysicalDevice, _queueFamilies[0],
+            calibratedTimestamps)),
+        _uploads(std::make_unique<UploadQueue>(
+            _vkDevice.get(), _workQueue, workQueueFamily,
+            _workCommandPool.get(), _queueFamilies[0],
+            _acquireCommandPool.get(), _vmaAllocator.get(), *_uploadTimeline,
+            *_graphicsTimeline, *_retiredUploads,
+            // Transfer-only queues can't reset queries.
+            workQueueFamily == _queueFamilies[0] ? _gpuProfiler.get()
+                                                 : nullptr)),
+        _pipelines(std::make_unique<PipelineRegistry>(_vkDevice.get(),
+                                                      _pipelineCache.get())) {}
 
+  // With `validation`, the Khronos validation layer is enabled when
+  // installed.
   static GraphicsDevice createFor(const Window &window,
                                   std::string_view appName,
-                                  AppVersion appVersion);
+                                  AppVersion appVersion, bool validation);
+  // Creates a device with no surface and no swapchain support, suitable for
+  // rendering into an `OffscreenTarget` (e.g. on a software driver).
+  static GraphicsDevice createHeadless(std::string_view appName,
+                                       AppVersion appVersion,
+                                       bool validation);
 
   inline vk::SurfaceKHR vkSurface() const { return _vkSurface.get(); }
+  inline bool isHeadless() const { return !_vkSurface; }
   inline vk::Device vkDevice() const { return _vkDevice.get(); }
   inline vk::PhysicalDevice vkPhysicalDevice() const {
     return _vkPhysicalDevice;
   }
+  // Optional features that were enabled on `vkDevice`.
+  inline const vk::PhysicalDeviceFeatures &features() const {
+    return _features;
+  }
+  // Whether `VK_KHR_present_id` and `VK_KHR_present_wait` are enabled, so
+  // swapchains can tell when their frames reach the display.
+  inline bool presentWait() const { return _presentWait; }
   inline vk::Format depthFormat() const { return _depthFormat; }
   inline vma::Allocator vmaAllocator() const { return _vmaAllocator.get(); }
   inline std::span<const QueueIndex> queueFamilies() const {
     return {_queueFamilies.data(), _queueFamilyCount};
   }
   inline QueueIndex graphicsQueueIndex() const { return _queueFamilies[0]; }
-  inline QueueIndex workQueueIndex() const { return _queueFamilies[0]; }
+  // Family of the queue uploads are submitted to: a dedicated transfer
+  // family when the device has one, the graphics family otherwise.
+  inline QueueIndex workQueueIndex() const { return _bufferQueueFamilies[1]; }
   inline QueueIndex presentQueueIndex() const { return _queueFamilies[1]; }
+  // Families buffers are shared by, so uploads can write them while frames
+  // read them: the graphics family, and the work family when it differs.
+  inline std::span<const QueueIndex> bufferQueueFamilies() const {
+    return {_bufferQueueFamilies.data(),
+            workQueueIndex() == graphicsQueueIndex() ? 1u : 2u};
+  }
   inline vk::Queue workQueue() const { return _workQueue; }
   inline vk::Queue graphicsQueue() const { return _graphicsQueue; }
   inline vk::Queue presentQueue() const { return _presentQueue; }
+  // Cache every pipeline should be created with. It is loaded from a file
+  // named after the device at startup, unless the file was written by
+  // another device or driver.
+  inline vk::PipelineCache pipelineCache() const {
+    return _pipelineCache.get();
+  }
+  // Whether the pipeline cache was loaded from disk rather than started
+  // empty.
+  inline bool pipelineCacheWarm() const { return _pipelineCacheWarm; }
+  // Graphics pipelines shared by the whole device, created through
+  // `pipelineCache`.
+  inline PipelineRegistry &pipelines() const { return *_pipelines; }
+  // Times frames on the GPU when enabled, and upload batches when they share
+  // the graphics queue.
+  // Timestamps are calibrated against `steady_clock` when the device
+  // supports `VK_EXT_calibrated_timestamps`.
+  inline GpuProfiler &gpuProfiler() const { return *_gpuProfiler; }
+  // Batches every buffer and texture upload, see `UploadQueue`.
+  inline UploadQueue &uploads() const { return *_uploads; }
 
   vk::UniqueCommandPool
   createGraphicsCommandPool(vk::CommandPoolCreateFlags flags) const;
   void waitIdle() const;
-  template <std::invocable<vk::CommandBuffer> TCommandBuilder>
-  void runOneTimeWork(TCommandBuilder buildFn) const;
+  // Every submission to the graphics queue signals the graphics timeline,
+  // and every upload batch the upload timeline. Values identify
+  // the work that signalled them, so waiting for work on the CPU or on
+  // another queue is a matter of comparing counters.
+  inline Timeline &graphicsTimeline() const { return *_graphicsTimeline; }
+  inline Timeline &uploadTimeline() const { return *_uploadTimeline; }
+  // Flushes the upload batch, then submits to the graphics queue, after every
+  // upload recorded so far and after acquiring the images they released.
+  // Returns the graphics timeline value signalled.
+  uint64_t submitGraphics(const vk::SubmitInfo &submitInfo) const;
+  // Keeps `resource` alive until the GPU is done with every graphics
+  // submission made so far and with the next one. The extra one covers
+  // presentation, which the timelines don't track. As graphics work waits for
+  // uploads, this also covers uploads.
+  template <class T> inline void retire(T resource) const {
+    _retired->retire(_graphicsTimeline->submittedValue() + 1,
+                     std::move(resource));
+  }
+  // Keeps `resource` alive until the uploads recorded so far are done, e.g.
+  // a buffer they copy from.
+  template <class T> inline void retireAfterUploads(T resource) const {
+    _retiredUploads->retire(_uploads->recorded().value, std::move(resource));
+  }
+  // Destroys the retired resources the GPU is done with. Cheap enough to call
+  // every frame.
+  void collectRetired() const;
+  // Writes the pipeline cache back to disk, replacing the previous file
+  // atomically. Meant to be called on shutdown.
+  void savePipelineCache() const;
 
 private:
   vk::UniqueInstance _vkInstance;
   vk::UniqueSurfaceKHR _vkSurface;
   vk::PhysicalDevice _vkPhysicalDevice;
   vk::UniqueDevice _vkDevice;
+  vk::PhysicalDeviceFeatures _features;
   vk::Format _depthFormat;
   std::array<QueueIndex, 2> _queueFamilies;
   uint32_t _queueFamilyCount;
+  std::array<QueueIndex, 2> _bufferQueueFamilies;
   vk::Queue _workQueue;
   vk::Queue _graphicsQueue;
   vk::Queue _presentQueue;
   vma::UniqueAllocator _vmaAllocator;
   vk::UniqueCommandPool _workCommandPool;
+  // Graphics command buffers acquiring uploaded images
+  vk::UniqueCommandPool _acquireCommandPool;
+  vk::UniquePipelineCache _pipelineCache;
+  std::string _pipelineCachePath;
+  bool _pipelineCacheWarm;
+  bool _presentWait;
+  std::unique_ptr<Timeline> _graphicsTimeline;
+  std::unique_ptr<Timeline> _uploadTimeline;
+  // After the allocator and the command pool, which retired resources may
+  // come from.
+  std::unique_ptr<DeletionQueue> _retired;
+  std::unique_ptr<DeletionQueue> _retiredUploads;
+  std::unique_ptr<GpuProfiler> _gpuProfiler;
+  std::unique_ptr<UploadQueue> _uploads;
+  // Last, so pipelines are destroyed before the cache and the device.
+  std::unique_ptr<PipelineRegistry> _pipelines;
 };
@@ -1,14 +1,23 @@
 #include "material.hpp"
 #include "materials/procedural.hpp"
+#include <algorithm>
 #include <array>
+#include <bit>
 #include <chrono>
 #include <cstdlib>
 #include <glm/ext/matrix_transform.hpp>
+#include <numeric>
+#include <optional>
 #include <print>
+#include <random>
 #include <ratio>
+#include <span>
+#include <stdexcept>
+#include <string>
 #include <string_view>
+#include <type_traits>
+#include <vector>
 
-#include <thread>
 #include <vulkan/vulkan.hpp>
 
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
@@ -16,25 +25,39 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include "bindless_heap.hpp"
 #include "buffer.hpp"
 #include "buffer_impl.hpp"
+#include "cpu_profiler.hpp"
+#include "draw_queue.hpp"
+#include "frame_scheduler.hpp"
+#include "frustum_culling.hpp"
 #include "graphics_device.hpp"
 #include "materials/colorful.hpp"
 #include "materials/procedural.hpp"
+#include "mesh_pool.hpp"
 #include "model.hpp"
 #include "model_impl.hpp"
+#include "offscreen_target.hpp"
 #include "render_system.hpp"
 #include "swapchain.hpp"
 #include "window.hpp"
 
-using Second = std::chrono::duration<uint64_t>;
 using FSecond = std::chrono::duration<float>;
-using FrameDuration = std::chrono::duration<uint64_t, std::nano>;
-using FFrameDuration = std::chrono::duration<float>;
+using FMillisecond = std::chrono::duration<float, std::milli>;
 
-const uint64_t MAX_FPS = 60;
-const FrameDuration MIN_FRAME_DURATION =
-    std::chrono::duration_cast<FrameDuration>(Second{1}) / MAX_FPS;
+// Simulation steps per second, whatever the frame rate.
+const uint64_t kSimulationRate = 60;
+const uint64_t kDefaultMaxFrameRate = 60;
+const uint64_t kDefaultHeadlessFrames = 1000;
+const vk::Extent2D kHeadlessExtent{640, 480};
+// Validation slows every frame down, so release builds only validate when
+// asked to.
+#ifdef NDEBUG
+const bool kDefaultValidation = false;
+#else
+const bool kDefaultValidation = true;
+#endif
 const auto kModelVertices =
     std::to_array<ColorfulMaterial::Vertex>({{1.0, 1.0, -1.0},
                                              {1.0, -1.0, -1.0},
@@ -59,98 +82,617 @@ const auto kSkyBoxVertices =
 const auto kSkyBoxIndices = std::to_array<uint16_t>(
     {0, 4, 2, 3, 2, 7, 7, 6, 5, 5, 1, 7, 1, 0, 3, 5, 4, 1,
      2, 4, 6, 7, 2, 6, 5, 6, 4, 7, 1, 3, 3, 0, 2, 1, 4, 0});
+const auto kSkyBoxVertShaderPath = "./assets/shaders/vaporwave_skybox.vert.spv";
+const auto kSkyBoxFragShaderPath = "./assets/shaders/vaporwave_skybox.frag.spv";
+const auto kSkyBoxInstancedVertShaderPath =
+    "./assets/shaders/vaporwave_skybox_instanced.vert.spv";
+// The sky box is seen from the inside.
+const vk::CullModeFlags kSkyBoxCullMode = vk::CullModeFlagBits::eFront;
+const vk::DeviceSize kMeshPoolVertexCapacity = 64 * 1024;
+const uint32_t kMeshPoolIndexCapacity = 16 * 1024;
+const uint64_t kCubeGridWidth = 100;
+const uint32_t kCullingBenchmarkSeed = 42;
+const float kCubeSpacing = 3.0f;
 
-template <std::invocable<FrameDuration> TTick>
-inline void runGameLoop(const Window &window, TTick tick) {
-  auto lastTime = std::chrono::system_clock::now();
-  FrameDuration totalTime{};
-  FrameDuration lag{};
+// `tick` is called once per frame, as paced by `scheduler`, and is
+// responsible for polling events.
+template <std::invocable<FrameScheduler::Tick> TTick>
+inline void runGameLoop(const Window &window, FrameScheduler &scheduler,
+                        TTick tick) {
   while (!window.shouldClose()) {
-    auto currentTime = std::chrono::system_clock::now();
-    auto deltaTime =
-        std::chrono::duration_cast<FrameDuration>(currentTime - lastTime);
-    lastTime = currentTime;
-    totalTime += deltaTime;
-    lag += deltaTime;
+    CPU_FRAME_MARK();
+    auto frameTick = [&] {
+      CPU_ZONE("pace frame");
+      return scheduler.beginFrame();
+    }();
+    CPU_ZONE("frame");
+    tick(frameTick);
+  }
+}
 
-    glfwPollEvents();
+// Extra cubes are laid out on a grid growing sideways and away from the
+// first one, which stays at the origin of the grid.
+glm::vec3 cubeOffset(uint64_t i) {
+  auto column = i % kCubeGridWidth;
+  auto row = i / kCubeGridWidth;
+  auto step = static_cast<float>((column + 1) / 2) * kCubeSpacing;
+  return {column % 2 == 0 ? -step : step, 0.0f,
+          static_cast<float>(row) * kCubeSpacing};
+}
 
-    if (lag < MIN_FRAME_DURATION) {
-      auto d = MIN_FRAME_DURATION - lag;
-      std::this_thread::sleep_for(d);
-      continue;
-    }
-    lag -= MIN_FRAME_DURATION;
+// Animated part of the scene, advanced in fixed steps.
+struct SceneState {
+  float seconds;
+  float cubeHeight;
 
-    tick(totalTime);
+  static SceneState at(float seconds) {
+    return {seconds, 7.0f + 6.0f * glm::sin(seconds * 1.5f)};
   }
-}
+  // Linear interpolation, `alpha` going from `a` to `b`.
+  static SceneState mix(const SceneState &a, const SceneState &b,
+                        float alpha) {
+    return {glm::mix(a.seconds, b.seconds, alpha),
+            glm::mix(a.cubeHeight, b.cubeHeight, alpha)};
+  }
+};
 
-int main(void) {
-  auto window = Window::create("Glock Engine", 640, 480);
-  auto device =
-      GraphicsDevice::createFor(window, "Glock Engine", MAKE_VERSION(0, 1, 0));
-  auto swapchain = Swapchain::create(window, device);
+struct Scene {
+  std::chrono::steady_clock::time_point pipelineRequestTime;
+  bool pipelinesReported = false;
+  uint64_t cubeCount;
+  MeshPool meshPool;
+  ColorfulMaterial material;
+  Model model;
+  ProceduralMaterial skyBoxMaterial;
+  Model skyBox;
+  DrawQueue drawQueue;
+  SceneState previousState;
+  SceneState state;
 
-  // Create systems
-  auto renderSystem = RenderSystem::create(device, swapchain);
+  static Scene load(const GraphicsDevice &device,
+                    const RenderSystem &renderSystem, uint64_t cubeCount) {
+    auto meshPool = MeshPool::create(device, kMeshPoolVertexCapacity,
+                                     kMeshPoolIndexCapacity);
+    auto model =
+        Model::fromRanges(device, meshPool, kModelVertices, kModelIndices);
+    auto skyBox =
+        Model::fromRanges(device, meshPool, kSkyBoxVertices, kSkyBoxIndices);
 
-  // Load model
-  auto material = ColorfulMaterial::create(device, renderSystem);
-  auto model = Model::fromRanges(device, kModelVertices, kModelIndices);
+    // Pipelines compile in the background; see `reportPipelines`.
+    auto pipelineRequestTime = std::chrono::steady_clock::now();
+    auto material = ColorfulMaterial::create(device, renderSystem);
+    auto skyBoxMaterial = ProceduralMaterial::create(
+        device, renderSystem, kSkyBoxVertShaderPath, kSkyBoxFragShaderPath,
+        kSkyBoxInstancedVertShaderPath, kSkyBoxCullMode);
+    // The uploads of the whole scene go to the GPU in a single submission.
+    device.uploads().flush();
 
-  // Load skybox
-  auto skyBoxMaterial = ProceduralMaterial::create(
-      device, renderSystem, "./assets/shaders/vaporwave_skybox.vert.spv",
-      "./assets/shaders/vaporwave_skybox.frag.spv");
-  auto skyBox = Model::fromRanges(device, kSkyBoxVertices, kSkyBoxIndices);
+    return {
+        pipelineRequestTime,
+        false,
+        cubeCount,
+        std::move(meshPool),
+        std::move(material),
+        std::move(model),
+        std::move(skyBoxMaterial),
+        std::move(skyBox),
+        DrawQueue{},
+        SceneState::at(0.0f),
+        SceneState::at(0.0f),
+    };
+  }
 
-  runGameLoop(window, [&](FrameDuration totalTime) {
-    material.setTime(totalTime);
+  // Prints how material pipelines were obtained once none of them is left
+  // compiling. Pipeline creation dominates startup, and is what the pipeline
+  // cache saves on the next launch.
+  void reportPipelines(const GraphicsDevice &device) {
+    if (pipelinesReported) {
+      return;
+    }
+    auto stats = device.pipelines().stats();
+    if (stats.compiled < stats.misses) {
+      return;
+    }
+    auto elapsed = std::chrono::duration<float, std::milli>(
+                       std::chrono::steady_clock::now() - pipelineRequestTime)
+                       .count();
+    std::println("Material pipelines ready after {:.2f}ms ({} pipeline cache, "
+                 "{} compiled in {:.2f}ms, {} reused)",
+                 elapsed, device.pipelineCacheWarm() ? "warm" : "cold",
+                 stats.misses, stats.compileTime.count(), stats.hits);
+    pipelinesReported = true;
+  }
+
+  void recreateMaterials(const GraphicsDevice &device,
+                         const RenderSystem &renderSystem) {
+    material =
+        ColorfulMaterial::create(device, renderSystem, std::move(material));
+    skyBoxMaterial = ProceduralMaterial::create(
+        device, renderSystem, kSkyBoxVertShaderPath, kSkyBoxFragShaderPath,
+        kSkyBoxInstancedVertShaderPath, kSkyBoxCullMode,
+        std::move(skyBoxMaterial));
+  }
+
+  void simulate(std::chrono::steady_clock::duration step) {
+    previousState = state;
+    state = SceneState::at(state.seconds + FSecond{step}.count());
+  }
+
+  // Renders the state `alpha` of the way from the previous step to the last.
+  void render(RenderSystem &renderSystem, Frame &frame, vk::Extent2D viewport,
+              float alpha) {
+    auto [seconds, cubeHeight] = SceneState::mix(previousState, state, alpha);
+    material.setTime(FSecond{seconds});
 
-    auto viewport = swapchain.extent();
     const float fov = glm::radians(90.0f);
     const float aspectRatio = static_cast<float>(viewport.width) /
                               static_cast<float>(viewport.height);
-    auto seconds = std::chrono::duration_cast<FSecond>(totalTime).count();
-    auto modelMat = glm::rotate(
-        glm::translate(
-            glm::identity<glm::mat4>(),
-            glm::vec3{0.0, 7.0 + 6.0 * glm::sin(seconds * 1.5), 12.0}),
-        seconds, glm::vec3{1.0, 2.0, 3.0});
     auto viewMat =
         glm::lookAt(glm::vec3{0.0, 0.0, 0.0}, glm::vec3{0.0, 0.5, 1.0},
                     glm::vec3{0.0, 1.0, 0.0});
     auto projMat = glm::perspective(fov, aspectRatio, 0.1f, 100.0f);
     projMat[1][1] *= -1;
-    auto modelMvp = projMat * viewMat * modelMat;
-    auto skyBoxMvp = projMat * viewMat;
+    auto viewProjection = projMat * viewMat;
+
+    drawQueue.clear();
+    drawQueue.setViewProjection(viewProjection);
+    for (uint64_t i = 0; i < cubeCount; i++) {
+      auto modelMat = glm::rotate(
+          glm::translate(glm::identity<glm::mat4>(),
+                         glm::vec3{0.0f, cubeHeight, 12.0f} + cubeOffset(i)),
+          seconds, glm::vec3{1.0, 2.0, 3.0});
+      drawQueue.push(material, {viewProjection * modelMat}, model, modelMat);
+    }
+    drawQueue.push(skyBoxMaterial, {viewProjection}, skyBox);
+    renderSystem.render(frame, viewport, drawQueue);
+  }
+};
+
+CullingMode parseCullingMode(std::string_view name) {
+  if (name == "none") {
+    return CullingMode::eNone;
+  }
+  if (name == "cpu") {
+    return CullingMode::eCpu;
+  }
+  if (name == "gpu") {
+    return CullingMode::eGpu;
+  }
+  throw std::runtime_error(std::format("unknown culling mode '{}'", name));
+}
+
+PresentPolicy parsePresentPolicy(std::string_view name) {
+  if (name == "vsync") {
+    return PresentPolicy::eVsync;
+  }
+  if (name == "relaxed") {
+    return PresentPolicy::eRelaxedVsync;
+  }
+  if (name == "mailbox") {
+    return PresentPolicy::eMailbox;
+  }
+  if (name == "immediate") {
+    return PresentPolicy::eImmediate;
+  }
+  throw std::runtime_error(std::format("unknown present mode '{}'", name));
+}
+
+struct Options {
+  bool headless = false;
+  // Whether to enable validation, by default only in windowed debug runs:
+  // headless runs measure throughput.
+  std::optional<bool> validation;
+  bool cullingBenchmark = false;
+  uint64_t headlessFrames = kDefaultHeadlessFrames;
+  uint64_t cubes = 1;
+  SubmissionMode submissionMode = SubmissionMode::eIndirect;
+  CullingMode cullingMode = CullingMode::eGpu;
+  size_t framesInFlight = RenderTarget::kDefaultConcurrentFrames;
+  PresentPolicy presentPolicy = PresentPolicy::eMailbox;
+  bool lowLatency = false;
+  uint64_t maxFrameRate = kDefaultMaxFrameRate;
+  bool gpuProfile = false;
+  bool drawStatistics = false;
+  bool overdrawView = false;
+  // Where to write a CPU trace, none when empty
+  std::string tracePath;
+
+  static Options parse(std::span<char *> args) {
+    Options options;
+    for (size_t i = 1; i < args.size(); i++) {
+      std::string_view arg = args[i];
+      if (arg == "--headless") {
+        options.headless = true;
+      } else if (arg == "--validation") {
+        options.validation = true;
+      } else if (arg == "--no-validation") {
+        options.validation = false;
+      } else if (arg == "--benchmark-culling") {
+        options.cullingBenchmark = true;
+      } else if (arg == "--frames" && i + 1 < args.size()) {
+        options.headlessFrames = std::stoull(args[++i]);
+      } else if (arg == "--cubes" && i + 1 < args.size()) {
+        options.cubes = std::stoull(args[++i]);
+      } else if (arg == "--direct") {
+        options.submissionMode = SubmissionMode::eDirect;
+      } else if (arg == "--culling" && i + 1 < args.size()) {
+        options.cullingMode = parseCullingMode(args[++i]);
+      } else if (arg == "--frames-in-flight" && i + 1 < args.size()) {
+        options.framesInFlight = std::stoull(args[++i]);
+      } else if (arg == "--present-mode" && i + 1 < args.size()) {
+        options.presentPolicy = parsePresentPolicy(args[++i]);
+      } else if (arg == "--low-latency") {
+        options.lowLatency = true;
+      } else if (arg == "--gpu-profile") {
+        options.gpuProfile = true;
+      } else if (arg == "--draw-stats") {
+        options.drawStatistics = true;
+      } else if (arg == "--overdraw") {
+        options.overdrawView = true;
+      } else if (arg == "--max-fps" && i + 1 < args.size()) {
+        options.maxFrameRate = std::stoull(args[++i]);
+      } else if (arg == "--trace" && i + 1 < args.size()) {
+        options.tracePath = args[++i];
+      } else {
+        throw std::runtime_error(std::format("unknown argument '{}'", arg));
+      }
+    }
+    return options;
+  }
+};
+
+// CPU time spent blocked in `nextImage`, waiting for the GPU (or the
+// presentation engine) to free a frame, versus building and recording frames.
+// Mostly blocked means the GPU is the bottleneck and fewer frames in flight
+// would cut latency for free; mostly recording means more would not help.
+struct FrameTimings {
+  using Duration = std::chrono::duration<float, std::milli>;
+
+  Duration blocked{};
+  Duration recording{};
+  uint64_t frames = 0;
+
+  template <class TFn> inline auto timeBlocked(TFn fn) {
+    return timed(blocked, fn);
+  }
+  template <class TFn> inline auto timeRecording(TFn fn) {
+    return timed(recording, fn);
+  }
+
+  void print(size_t framesInFlight) const {
+    auto count = static_cast<float>(std::max(frames, uint64_t{1}));
+    std::println("{} frames in flight: {:.3f}ms blocked in nextImage and "
+                 "{:.3f}ms recording per frame",
+                 framesInFlight, blocked.count() / count,
+                 recording.count() / count);
+  }
+
+private:
+  template <class TFn> static auto timed(Duration &total, TFn fn) {
+    auto start = std::chrono::steady_clock::now();
+    auto measure = [&] { total += std::chrono::steady_clock::now() - start; };
+    if constexpr (std::is_void_v<decltype(fn())>) {
+      fn();
+      measure();
+    } else {
+      auto result = fn();
+      measure();
+      return result;
+    }
+  }
+};
+
+// Average, percentiles and worst of `samples`, which must not be empty.
+std::string describeDistribution(std::span<const FMillisecond> samples) {
+  auto sorted = samples | std::ranges::to<std::vector>();
+  std::ranges::sort(sorted);
+  auto percentile = [&](float p) {
+    auto rank = p * static_cast<float>(sorted.size() - 1);
+    return sorted[static_cast<size_t>(rank)].count();
+  };
+  auto total = std::accumulate(sorted.begin(), sorted.end(), FMillisecond{});
+  return std::format("{:.2f}ms average, {:.2f}ms median, {:.2f}ms p90, "
+                     "{:.2f}ms p99, {:.2f}ms max",
+                     total.count() / static_cast<float>(sorted.size()),
+                     percentile(0.5f), percentile(0.9f), percentile(0.99f),
+                     sorted.back().count());
+}
+
+// Latency from sampling input to the frame reaching the display, or to
+// presenting it when the swapchain can't tell when it is displayed.
+void printLatencies(const Swapchain &swapchain) {
+  auto latencies = swapchain.latencies();
+  if (latencies.empty()) {
+    return;
+  }
+  std::println("Input to {} latency over {} frames: {}",
+               swapchain.measuresDisplayLatency() ? "display" : "present",
+               latencies.size(), describeDistribution(latencies));
+}
+
+// Spread of frame times shows how evenly frames are paced.
+void printFrameTimes(const FrameScheduler &scheduler) {
+  auto frameTimes = scheduler.frameTimes();
+  if (frameTimes.empty()) {
+    return;
+  }
+  std::println("Frame times over {} frames: {}", frameTimes.size(),
+               describeDistribution(frameTimes));
+}
+
+// Enables the GPU profiler when asked to, warning when it can't be.
+void setUpGpuProfiler(const Options &options, const GraphicsDevice &device) {
+  auto &profiler = device.gpuProfiler();
+  if (options.gpuProfile && !profiler.supported()) {
+    std::println("GPU profiling unavailable: the graphics queue has no "
+                 "timestamps");
+  }
+  profiler.setEnabled(options.gpuProfile);
+}
+
+// Enables draw statistics and the overdraw view when asked to, warning when
+// statistics can't be counted.
+void setUpDrawAnalysis(const Options &options, RenderSystem &renderSystem) {
+  auto &statistics = renderSystem.drawStatistics();
+  if (options.drawStatistics && !statistics.supported()) {
+    std::println("Draw statistics unavailable: the device has no pipeline "
+                 "statistics queries");
+  }
+  statistics.setEnabled(options.drawStatistics);
+  renderSystem.setOverdrawView(options.overdrawView);
+}
+
+// Average work of each material's draws per frame. Fragments per pixel beyond
+// the share of the screen a material covers are overdraw: fragments shaded
+// and then drawn over, or shaded although hidden by something drawn earlier.
+void printDrawStatistics(DrawStatistics &statistics) {
+  statistics.collect();
+  if (statistics.stats().empty()) {
+    return;
+  }
+  std::println("Draw statistics per frame:");
+  for (const auto &draw : statistics.stats()) {
+    auto frames = static_cast<double>(draw.frames);
+    auto fragments = static_cast<double>(draw.total.fragmentInvocations);
+    std::println("  {}: {:.1f} draws, {:.0f} vertices, {:.0f} primitives, "
+                 "{:.0f} fragments ({:.2f} per pixel)",
+                 draw.name, static_cast<double>(draw.draws) / frames,
+                 static_cast<double>(draw.total.vertexInvocations) / frames,
+                 static_cast<double>(draw.total.clippingPrimitives) / frames,
+                 fragments / frames,
+                 fragments / static_cast<double>(draw.pixels));
+  }
+}
+
+// Starts recording CPU zones when a trace is asked for, warning when they
+// were compiled out.
+void startCpuTrace(const Options &options) {
+  if (options.tracePath.empty()) {
+    return;
+  }
+  if (!CpuProfiler::kCompiledIn) {
+    std::println("CPU tracing unavailable: built without "
+                 "ENGINE_CPU_PROFILING");
+    return;
+  }
+  CPU_THREAD_NAME("main");
+  CpuProfiler::start();
+}
+
+void writeCpuTrace(const Options &options) {
+  if (options.tracePath.empty() || !CpuProfiler::kCompiledIn) {
+    return;
+  }
+  CpuProfiler::stop();
+  CpuProfiler::writeChromeTrace(options.tracePath);
+  std::println("CPU trace written to {}", options.tracePath);
+}
+
+// Average and worst GPU time of every profiled scope, indented under its
+// parent. Root scopes also show how long the GPU took to start them once
+// submitted, when timestamps are calibrated.
+void printGpuProfile(GpuProfiler &profiler) {
+  profiler.collect();
+  auto stats = profiler.stats();
+  if (stats.empty()) {
+    return;
+  }
+  std::println("GPU time per scope:");
+  for (const auto &scope : stats) {
+    auto name = std::string_view{scope.path}.substr(scope.path.rfind('/') + 1);
+    auto count = static_cast<double>(scope.count);
+    std::print("{:{}}{}: {:.3f}ms average, {:.3f}ms max over {}", "",
+               scope.depth * 2 + 2, name, scope.total.count() / count,
+               scope.max.count(), scope.count);
+    if (scope.totalQueueDelay.has_value()) {
+      std::print(", started {:.3f}ms after submission on average",
+                 scope.totalQueueDelay->count() / count);
+    }
+    std::println("");
+  }
+  if (auto dropped = profiler.droppedBatches(); dropped > 0) {
+    std::println("{} submissions not profiled, too many were in flight",
+                 dropped);
+  }
+}
 
+int runWindowed(const Options &options) {
+  auto window = Window::create("Glock Engine", 640, 480);
+  auto device = GraphicsDevice::createFor(
+      window, "Glock Engine", MAKE_VERSION(0, 1, 0),
+      options.validation.value_or(kDefaultValidation));
+  setUpGpuProfiler(options, device);
+  auto swapchain = Swapchain::create(
+      window, device,
+      {options.framesInFlight, options.presentPolicy, options.lowLatency});
+  std::println("Presenting in {} mode{}",
+               vk::to_string(swapchain.presentMode()),
+               swapchain.measuresDisplayLatency() ? " with present wait" : "");
+
+  // Create systems
+  auto bindlessHeap = BindlessHeap::create(device);
+  auto renderSystem = RenderSystem::create(device, bindlessHeap, swapchain);
+  renderSystem.setSubmissionMode(options.submissionMode);
+  renderSystem.setCullingMode(options.cullingMode);
+  setUpDrawAnalysis(options, renderSystem);
+
+  // Load scene
+  auto scene = Scene::load(device, renderSystem, options.cubes);
+
+  FrameTimings timings;
+  auto scheduler =
+      FrameScheduler::create(kSimulationRate, options.maxFrameRate);
+  runGameLoop(window, scheduler, [&](FrameScheduler::Tick tick) {
     if (swapchain.needsRecreation()) {
       window.waitForValidDimensions();
-      device.waitIdle();
-      swapchain = Swapchain::create(window, device, std::move(swapchain));
-      renderSystem =
-          RenderSystem::create(device, swapchain, std::move(renderSystem));
-      material =
-          ColorfulMaterial::create(device, renderSystem, std::move(material));
-      skyBoxMaterial = ProceduralMaterial::create(
-          device, renderSystem, "./assets/shaders/vaporwave_skybox.vert.spv",
-          "./assets/shaders/vaporwave_skybox.frag.spv",
-          std::move(skyBoxMaterial));
+      swapchain = Swapchain::create(window, device, {}, std::move(swapchain));
+      // Pipelines only depend on attachment formats, which resizing keeps.
+      if (renderSystem.isCompatible(swapchain)) {
+        renderSystem.resize(swapchain);
+      } else {
+        renderSystem = RenderSystem::create(device, bindlessHeap, swapchain,
+                                            std::move(renderSystem));
+        scene.recreateMaterials(device, renderSystem);
+      }
     }
 
-    auto frame = swapchain.nextImage();
+    auto frame = timings.timeBlocked([&] { return swapchain.nextImage(); });
+    // Input is sampled just before simulating and recording, once the frame
+    // can start, so it is as fresh as possible by the time the frame is
+    // displayed.
+    glfwPollEvents();
+    auto inputTime = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < tick.steps; i++) {
+      scene.simulate(scheduler.step());
+    }
     if (!frame.has_value()) {
       return;
     }
-    renderSystem.render(*frame, viewport,
-                        {
-                            {material, {modelMvp}, model},
-                            {skyBoxMaterial, {skyBoxMvp}, skyBox},
-                        });
+    frame->inputTime = inputTime;
+    timings.timeRecording([&] {
+      scene.render(renderSystem, *frame, swapchain.extent(), tick.alpha);
+    });
+    timings.frames++;
     swapchain.present(*frame);
+    scene.reportPipelines(device);
   });
+  timings.print(swapchain.framesInFlight());
+  printLatencies(swapchain);
+  printFrameTimes(scheduler);
+  device.waitIdle();
+  printGpuProfile(device.gpuProfiler());
+  printDrawStatistics(renderSystem.drawStatistics());
+  device.savePipelineCache();
+  return 0;
+}
+
+// Renders a fixed number of frames into an offscreen target as fast as
+// possible, advancing the simulation by one step per frame. Meant for
+// automated throughput measurements (e.g. on lavapipe), so nothing here
+// touches GLFW.
+int runHeadless(const Options &options) {
+  auto device =
+      GraphicsDevice::createHeadless("Glock Engine", MAKE_VERSION(0, 1, 0),
+                                     options.validation.value_or(false));
+  setUpGpuProfiler(options, device);
+  auto target =
+      OffscreenTarget::create(device, kHeadlessExtent, options.framesInFlight);
+  auto bindlessHeap = BindlessHeap::create(device);
+  auto renderSystem = RenderSystem::create(device, bindlessHeap, target);
+  renderSystem.setSubmissionMode(options.submissionMode);
+  renderSystem.setCullingMode(options.cullingMode);
+  setUpDrawAnalysis(options, renderSystem);
+  auto scene = Scene::load(device, renderSystem, options.cubes);
+  // Frames rendered while pipelines compile would skip most draws.
+  device.pipelines().waitIdle();
+  scene.reportPipelines(device);
+
+  FrameTimings timings;
+  auto step = FrameScheduler::create(kSimulationRate, 0).step();
+  auto startTime = std::chrono::steady_clock::now();
+  for (uint64_t i = 0; i < options.headlessFrames; i++) {
+    CPU_FRAME_MARK();
+    CPU_ZONE("frame");
+    auto frame = timings.timeBlocked([&] { return target.nextImage(); });
+    scene.simulate(step);
+    timings.timeRecording([&] {
+      scene.render(renderSystem, *frame, target.extent(), 1.0f);
+    });
+    timings.frames++;
+    target.present(*frame);
+  }
   device.waitIdle();
+  device.savePipelineCache();
+  auto elapsed = std::chrono::duration_cast<FSecond>(
+                     std::chrono::steady_clock::now() - startTime)
+                     .count();
+
+  std::println("{} frames in {:.3f}s ({:.1f} frames/s)",
+               target.presentedFrames(), elapsed,
+               static_cast<float>(target.presentedFrames()) / elapsed);
+  timings.print(target.framesInFlight());
+  printGpuProfile(device.gpuProfiler());
+  printDrawStatistics(renderSystem.drawStatistics());
   return 0;
 }
+
+// Measures how many bounding spheres each CPU culling kernel supported by this
+// machine tests per millisecond. Spheres are scattered uniformly around the
+// camera, so most of them end up outside the frustum.
+int runCullingBenchmark() {
+  const auto counts = std::to_array<size_t>({10'000, 100'000, 1'000'000});
+  const auto kernels = std::to_array<std::pair<CullingKernel, const char *>>({
+      {CullingKernel::eScalar, "scalar"},
+      {CullingKernel::eSse, "sse"},
+      {CullingKernel::eAvx2, "avx2"},
+  });
+  auto projMat =
+      glm::perspective(glm::radians(90.0f), 16.0f / 9.0f, 0.1f, 100.0f);
+  auto viewMat = glm::lookAt(glm::vec3{0.0, 0.0, 0.0}, glm::vec3{0.0, 0.5, 1.0},
+                             glm::vec3{0.0, 1.0, 0.0});
+  auto frustum = Frustum::fromMatrix(projMat * viewMat);
+
+  std::mt19937 random{kCullingBenchmarkSeed};
+  std::uniform_real_distribution<float> position{-100.0f, 100.0f};
+  std::uniform_real_distribution<float> radius{0.5f, 2.0f};
+  VisibilityMask visible;
+  for (auto count : counts) {
+    BoundingSpheres spheres;
+    for (size_t i = 0; i < count; i++) {
+      spheres.push({{position(random), position(random), position(random)},
+                    radius(random)});
+    }
+    for (auto [kernel, name] : kernels) {
+      if (kernel > BoundingSpheres::bestKernel()) {
+        continue;
+      }
+      const size_t runs = std::max<size_t>(1, 10'000'000 / count);
+      auto startTime = std::chrono::steady_clock::now();
+      for (size_t run = 0; run < runs; run++) {
+        spheres.cull(frustum, visible, kernel);
+      }
+      auto elapsed = std::chrono::duration<float, std::milli>(
+                         std::chrono::steady_clock::now() - startTime)
+                         .count();
+      size_t visibleCount = 0;
+      for (auto word : visible) {
+        visibleCount += static_cast<size_t>(std::popcount(word));
+      }
+      std::println("{:>8} objects {:>7}: {:>10.0f} objects/ms ({} visible)",
+                   count, name,
+                   static_cast<float>(count * runs) / elapsed, visibleCount);
+    }
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  auto options = Options::parse(std::span{argv, static_cast<size_t>(argc)});
+  if (options.cullingBenchmark) {
+    return runCullingBenchmark();
+  }
+  startCpuTrace(options);
+  auto result = options.headless ? runHeadless(options) : runWindowed(options);
+  writeCpuTrace(options);
+  return result;
+}
@@ -1,17 +1,118 @@
 #pragma once
 
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <string_view>
+
 #include <vulkan/vulkan.hpp>
 
 #include <glm/glm.hpp>
 
+#include "bindless_heap.hpp"
+#include "pipeline_registry.hpp"
+
 struct MeshUniforms {
   glm::mat4 mvp;
 };
 
+// Per-draw data, built by `DrawQueue` from the `MeshUniforms` of a draw and
+// the index of its material. Single draws push it, while instanced draws read
+// it from an instance-rate vertex binding, one matrix column per attribute.
+// Must match `PerMeshUniforms` and `InstanceInput` in the shaders.
+struct InstanceData {
+  glm::mat4 mvp;
+  MaterialIndex material;
+  uint32_t padding[3];
+};
+static_assert(sizeof(InstanceData) == 80);
+
+const uint32_t kInstanceBinding = 1;
+const uint32_t kInstanceLocation = 1;
+constexpr auto kInstanceBindings = std::to_array({
+    vk::VertexInputBindingDescription{kInstanceBinding, sizeof(InstanceData),
+                                      vk::VertexInputRate::eInstance},
+});
+constexpr auto kInstanceAttributes = std::to_array({
+    vk::VertexInputAttributeDescription{
+        kInstanceLocation + 0, kInstanceBinding,
+        vk::Format::eR32G32B32A32Sfloat, 0 * sizeof(glm::vec4)},
+    vk::VertexInputAttributeDescription{
+        kInstanceLocation + 1, kInstanceBinding,
+        vk::Format::eR32G32B32A32Sfloat, 1 * sizeof(glm::vec4)},
+    vk::VertexInputAttributeDescription{
+        kInstanceLocation + 2, kInstanceBinding,
+        vk::Format::eR32G32B32A32Sfloat, 2 * sizeof(glm::vec4)},
+    vk::VertexInputAttributeDescription{
+        kInstanceLocation + 3, kInstanceBinding,
+        vk::Format::eR32G32B32A32Sfloat, 3 * sizeof(glm::vec4)},
+    vk::VertexInputAttributeDescription{kInstanceLocation + 4,
+                                        kInstanceBinding, vk::Format::eR32Uint,
+                                        offsetof(InstanceData, material)},
+});
+
+template <class T, size_t N, size_t M>
+constexpr std::array<T, N + M> concatArrays(const std::array<T, N> &a,
+                                            const std::array<T, M> &b) {
+  std::array<T, N + M> result{};
+  std::ranges::copy(a, result.begin());
+  std::ranges::copy(b, result.begin() + N);
+  return result;
+}
+
+// Vertex input of the instanced variant of a pipeline: the mesh vertex layout
+// `TVertex` followed by the per-instance attributes.
+template <class TVertex> struct InstancedVertex {
+  static constexpr auto kBindings =
+      concatArrays(TVertex::kBindings, kInstanceBindings);
+  static constexpr auto kAttributes =
+      concatArrays(TVertex::kAttributes, kInstanceAttributes);
+};
+
+// Plain and instanced variants of a material pipeline, as requested from the
+// `PipelineRegistry`.
+struct MaterialPipelines {
+  PipelineHandle plain;
+  PipelineHandle instanced;
+
+  // Null until both variants are ready, so a material never switches
+  // variants halfway through its draws.
+  inline vk::Pipeline vkPipeline() const {
+    return plain.ready() && instanced.ready() ? plain.get() : nullptr;
+  }
+  inline vk::Pipeline vkPipeline(bool isInstanced) const {
+    return isInstanced ? instanced.get() : plain.get();
+  }
+};
+
 struct Frame;
+struct FrameAllocator;
+// Materials are created with the `BindlessHeap`'s pipeline layout, and keep
+// their parameters in the heap rather than in descriptor sets of their own.
+// Draws are grouped by pipeline only, so materials sharing a pipeline must
+// bind the same state and only differ in their `materialIndex`.
 struct Material {
   virtual ~Material() {}
-  virtual void render(const Frame &frame, vk::CommandBuffer cmd,
-                      const MeshUniforms &meshUniforms, vk::Buffer vertexBuffer,
-                      vk::Buffer indexBuffer, uint32_t indexCount) const = 0;
+  // Used to order and group draws; see `DrawQueue`. Null while the pipeline
+  // is still compiling, in which case the material's draws are skipped.
+  virtual vk::Pipeline vkPipeline() const = 0;
+  // What `vkPipeline` comes from, e.g. to draw the material's geometry with
+  // a variant of it.
+  virtual const MaterialPipelines &pipelines() const = 0;
+  // Slot of the material's parameters in the `BindlessHeap`.
+  virtual MaterialIndex materialIndex() const {
+    return BindlessHeap::kDefaultMaterial;
+  }
+  // Names the pipeline's draws in profiles.
+  virtual std::string_view name() const = 0;
+  // Binds the pipeline and any per-pipeline state. Only called when the
+  // previous draw used a different pipeline or variant. The instanced
+  // variant reads its transforms from `kInstanceBinding` instead of
+  // `pushMeshUniforms`. Per-frame uniforms are allocated from
+  // `frameAllocator`, which may be shared with other threads recording the
+  // frame.
+  virtual void bind(const Frame &frame, vk::CommandBuffer cmd, bool instanced,
+                    FrameAllocator &frameAllocator) const = 0;
+  virtual void pushMeshUniforms(vk::CommandBuffer cmd,
+                                const InstanceData &instance) const = 0;
 };
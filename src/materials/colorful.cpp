@@ -4,6 +4,8 @@
 #include <vulkan/vulkan_enums.hpp>
 
 #include "../buffer_impl.hpp"
+#include "../cpu_profiler.hpp"
+#include "../frame_allocator.hpp"
 #include "../graphics_device.hpp"
 #include "../render_system.hpp"
 #include "../swapchain.hpp"
@@ -11,101 +13,40 @@
 
 const auto kVertShaderPath = "./assets/shaders/colorful.vert.spv";
 const auto kFragShaderPath = "./assets/shaders/colorful.frag.spv";
-
-static vk::UniquePipeline
-createPipeline(vk::PipelineLayout layout,
-               std::span<vk::UniqueShaderModule, 2> shaderModules,
-               vk::RenderPass renderPass, vk::Device device) {
-  auto stages = std::to_array({
-      vk::PipelineShaderStageCreateInfo{
-          {}, vk::ShaderStageFlagBits::eVertex, *shaderModules[0], "main"},
-      vk::PipelineShaderStageCreateInfo{
-          {}, vk::ShaderStageFlagBits::eFragment, *shaderModules[1], "main"},
-  });
-  vk::PipelineVertexInputStateCreateInfo vertexInputInfo{
-      {},
-      ColorfulMaterial::Vertex::kBindings,
-      ColorfulMaterial::Vertex::kAttributes};
-  vk::PipelineInputAssemblyStateCreateInfo inputAssemblyInfo{
-      {}, vk::PrimitiveTopology::eTriangleList};
-  auto dynamicStates = std::to_array({
-      vk::DynamicState::eViewport,
-      vk::DynamicState::eScissor,
-  });
-  auto dynamicStatesInfo =
-      vk::PipelineDynamicStateCreateInfo{}.setDynamicStates(dynamicStates);
-  auto rasterizationState =
-      vk::PipelineRasterizationStateCreateInfo{}.setLineWidth(1.0f);
-  auto viewportState =
-      vk::PipelineViewportStateCreateInfo{}.setViewportCount(1).setScissorCount(
-          1);
-  vk::PipelineMultisampleStateCreateInfo multisampleState{};
-  auto depthStencilState = vk::PipelineDepthStencilStateCreateInfo{}
-                               .setDepthTestEnable(true)
-                               .setDepthWriteEnable(true)
-                               .setDepthCompareOp(vk::CompareOp::eLess);
-  auto colorBlendingAttachments = std::to_array({
-      vk::PipelineColorBlendAttachmentState{}
-          .setBlendEnable(false)
-          .setColorWriteMask(
-              vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG |
-              vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA),
-  });
-  auto colorBlendState = vk::PipelineColorBlendStateCreateInfo{}.setAttachments(
-      colorBlendingAttachments);
-  auto pipeline = device
-                      .createGraphicsPipelineUnique(
-                          {}, vk::GraphicsPipelineCreateInfo{}
-                                  .setStages(stages)
-                                  .setPVertexInputState(&vertexInputInfo)
-                                  .setPInputAssemblyState(&inputAssemblyInfo)
-                                  .setPViewportState(&viewportState)
-                                  .setPRasterizationState(&rasterizationState)
-                                  .setPMultisampleState(&multisampleState)
-                                  .setPDepthStencilState(&depthStencilState)
-                                  .setPColorBlendState(&colorBlendState)
-                                  .setPDynamicState(&dynamicStatesInfo)
-                                  .setLayout(layout)
-                                  .setRenderPass(renderPass))
-                      .value;
-  return pipeline;
-}
+const auto kInstancedVertShaderPath =
+    "./assets/shaders/colorful_instanced.vert.spv";
 
 ColorfulMaterial ColorfulMaterial::create(const GraphicsDevice &device,
                                           const RenderSystem &renderSystem,
                                           std::optional<ColorfulMaterial>) {
-  auto vkDevice = device.vkDevice();
-
-  auto pushConstantRanges = std::to_array(
-      {vk::PushConstantRange{kVertexAndFragmentStages, 0,
-                             sizeof(MeshUniforms) + sizeof(PerFrameUniforms)}});
-  static_assert(sizeof(MeshUniforms) + sizeof(PerFrameUniforms) < 128,
+  CPU_ZONE("create colorful material");
+  static_assert(sizeof(InstanceData) <= BindlessHeap::kPushConstantSize,
                 "Push constant bigger than minimum guaranteed size.");
-  auto pipelineLayout = vkDevice.createPipelineLayoutUnique(
-      vk::PipelineLayoutCreateInfo{}.setPushConstantRanges(pushConstantRanges));
-
-  auto shaderModules = std::to_array({
-      loadShaderFromPath(kVertShaderPath, vkDevice),
-      loadShaderFromPath(kFragShaderPath, vkDevice),
-  });
-  auto pipeline = createPipeline(pipelineLayout.get(), shaderModules,
-                                 renderSystem.vkRenderPass(), vkDevice);
+  static_assert(sizeof(PerFrameUniforms) <= FrameAllocator::kMaxUniformSize);
+  auto pipelineLayout = renderSystem.bindlessHeap().vkPipelineLayout();
+
+  PipelineDesc desc;
+  desc.vertexShader = kVertShaderPath;
+  desc.fragmentShader = kFragShaderPath;
+  desc.layout = pipelineLayout;
+  desc.setTargets(renderSystem.pipelineRenderingInfo());
+  auto pipelines = requestMaterialPipelines<Vertex>(
+      device.pipelines(), std::move(desc), kInstancedVertShaderPath);
+
+  return {pipelineLayout, pipelines};
+}
 
-  return {std::move(pipelineLayout), std::move(shaderModules),
-          std::move(pipeline)};
+void ColorfulMaterial::bind(const Frame &, vk::CommandBuffer cmd,
+                            bool instanced,
+                            FrameAllocator &frameAllocator) const {
+  cmd.bindPipeline(vk::PipelineBindPoint::eGraphics,
+                   _pipelines.vkPipeline(instanced));
+  frameAllocator.bindUniforms(cmd, _vkPipelineLayout,
+                              frameAllocator.push(PerFrameUniforms{_time}));
 }
 
-void ColorfulMaterial::render(const Frame &, vk::CommandBuffer cmd,
-                              const MeshUniforms &meshUniforms,
-                              vk::Buffer vertexBuffer, vk::Buffer indexBuffer,
-                              uint32_t indexCount) const {
-  cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, _vkPipeline.get());
-  cmd.pushConstants<MeshUniforms>(_vkPipelineLayout.get(),
-                                  kVertexAndFragmentStages, 0, meshUniforms);
-  cmd.pushConstants<PerFrameUniforms>(
-      _vkPipelineLayout.get(), kVertexAndFragmentStages, sizeof(MeshUniforms),
-      PerFrameUniforms{_time});
-  cmd.bindVertexBuffers(0, vertexBuffer, {0});
-  cmd.bindIndexBuffer(indexBuffer, 0, vk::IndexType::eUint16);
-  cmd.drawIndexed(indexCount, 1, 0, 0, 0);
+void ColorfulMaterial::pushMeshUniforms(
+    vk::CommandBuffer cmd, const InstanceData &instance) const {
+  cmd.pushConstants<InstanceData>(_vkPipelineLayout, kVertexAndFragmentStages,
+                                  0, instance);
 }
@@ -14,17 +14,16 @@ struct RenderSystem;
 struct ColorfulMaterial : public Material {
   using Duration = std::chrono::duration<float>;
 
-  ColorfulMaterial(vk::UniquePipelineLayout vkPipelineLayout,
-                   std::array<vk::UniqueShaderModule, 2> vkShaderModules,
-                   vk::UniquePipeline vkPipeline)
-      : _vkPipelineLayout(std::move(vkPipelineLayout)),
-        _vkShaderModules(std::move(vkShaderModules)),
-        _vkPipeline(std::move(vkPipeline)) {}
+  ColorfulMaterial(vk::PipelineLayout vkPipelineLayout,
+                   MaterialPipelines pipelines)
+      : _vkPipelineLayout(vkPipelineLayout), _pipelines(pipelines) {}
 
   static ColorfulMaterial
   create(const GraphicsDevice &device, const RenderSystem &renderSystem,
          std::optional<ColorfulMaterial> old = std::nullopt);
 
+  // Allocated from the `FrameAllocator` on every bind. Must match
+  // `PerFrameUniforms` in `colorful.h.hlsl`.
   struct PerFrameUniforms {
     float time;
   };
@@ -46,13 +45,18 @@ struct ColorfulMaterial : public Material {
   template <class TDuration> inline void setTime(const TDuration &value) {
     _time = std::chrono::duration_cast<Duration>(value).count();
   }
-  void render(const Frame &frame, vk::CommandBuffer cmd,
-              const MeshUniforms &meshUniforms, vk::Buffer vertexBuffer,
-              vk::Buffer indexBuffer, uint32_t indexCount) const;
+  inline vk::Pipeline vkPipeline() const { return _pipelines.vkPipeline(); }
+  inline const MaterialPipelines &pipelines() const { return _pipelines; }
+  inline std::string_view name() const { return "colorful"; }
+  void bind(const Frame &frame, vk::CommandBuffer cmd, bool instanced,
+            FrameAllocator &frameAllocator) const;
+  void pushMeshUniforms(vk::CommandBuffer cmd,
+                        const InstanceData &instance) const;
 
 private:
-  vk::UniquePipelineLayout _vkPipelineLayout;
-  std::array<vk::UniqueShaderModule, 2> _vkShaderModules;
-  vk::UniquePipeline _vkPipeline;
+  // Owned by the `BindlessHeap`
+  vk::PipelineLayout _vkPipelineLayout;
+  // Owned by the device's `PipelineRegistry`
+  MaterialPipelines _pipelines;
   float _time = 0.0;
 };
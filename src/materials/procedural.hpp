@@ -1,5 +1,6 @@
 #pragma once
 
+#include <string>
 #include <string_view>
 
 #include <glm/glm.hpp>
@@ -12,16 +13,15 @@
 struct GraphicsDevice;
 struct RenderSystem;
 struct ProceduralMaterial : public Material {
-  ProceduralMaterial(vk::UniquePipelineLayout vkPipelineLayout,
-                     std::array<vk::UniqueShaderModule, 2> vkShaderModules,
-                     vk::UniquePipeline vkPipeline)
-      : _vkPipelineLayout(std::move(vkPipelineLayout)),
-        _vkShaderModules(std::move(vkShaderModules)),
-        _vkPipeline(std::move(vkPipeline)) {}
+  ProceduralMaterial(vk::PipelineLayout vkPipelineLayout,
+                     MaterialPipelines pipelines, std::string name)
+      : _vkPipelineLayout(vkPipelineLayout), _pipelines(pipelines),
+        _name(std::move(name)) {}
 
   static ProceduralMaterial
   create(const GraphicsDevice &device, const RenderSystem &renderSystem,
          std::string_view vertShaderPath, std::string_view fragShaderPath,
+         std::string_view instancedVertShaderPath, vk::CullModeFlags cullMode,
          std::optional<ProceduralMaterial> old = std::nullopt);
 
   struct Vertex {
@@ -38,12 +38,19 @@ struct ProceduralMaterial : public Material {
     });
   };
 
-  void render(const Frame &frame, vk::CommandBuffer cmd,
-              const MeshUniforms &meshUniforms, vk::Buffer vertexBuffer,
-              vk::Buffer indexBuffer, uint32_t indexCount) const;
+  inline vk::Pipeline vkPipeline() const { return _pipelines.vkPipeline(); }
+  inline const MaterialPipelines &pipelines() const { return _pipelines; }
+  // Named after its fragment shader
+  inline std::string_view name() const { return _name; }
+  void bind(const Frame &frame, vk::CommandBuffer cmd, bool instanced,
+            FrameAllocator &frameAllocator) const;
+  void pushMeshUniforms(vk::CommandBuffer cmd,
+                        const InstanceData &instance) const;
 
 private:
-  vk::UniquePipelineLayout _vkPipelineLayout;
-  std::array<vk::UniqueShaderModule, 2> _vkShaderModules;
-  vk::UniquePipeline _vkPipeline;
+  // Owned by the `BindlessHeap`
+  vk::PipelineLayout _vkPipelineLayout;
+  // Owned by the device's `PipelineRegistry`
+  MaterialPipelines _pipelines;
+  std::string _name;
 };
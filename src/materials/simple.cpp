@@ -6,7 +6,8 @@
 
 #include <vulkan/vulkan.hpp>
 
-#include "../buffer_impl.hpp"
+#include "../bindless_heap.hpp"
+#include "../cpu_profiler.hpp"
 #include "../graphics_device.hpp"
 #include "../render_system.hpp"
 #include "../swapchain.hpp"
@@ -14,137 +15,47 @@
 
 const auto kVertShaderPath = "./assets/shaders/simple.vert.spv";
 const auto kFragShaderPath = "./assets/shaders/simple.frag.spv";
-
-static vk::UniquePipeline
-createPipeline(vk::PipelineLayout layout,
-               std::span<vk::UniqueShaderModule, 2> shaderModules,
-               vk::RenderPass renderPass, vk::Device device) {
-  auto stages = std::to_array({
-      vk::PipelineShaderStageCreateInfo{
-          {}, vk::ShaderStageFlagBits::eVertex, *shaderModules[0], "main"},
-      vk::PipelineShaderStageCreateInfo{
-          {}, vk::ShaderStageFlagBits::eFragment, *shaderModules[1], "main"},
-  });
-  vk::PipelineVertexInputStateCreateInfo vertexInputInfo{
-      {},
-      SimpleMaterial::Vertex::kBindings,
-      SimpleMaterial::Vertex::kAttributes};
-  vk::PipelineInputAssemblyStateCreateInfo inputAssemblyInfo{
-      {}, vk::PrimitiveTopology::eTriangleList};
-  auto dynamicStates = std::to_array({
-      vk::DynamicState::eViewport,
-      vk::DynamicState::eScissor,
-  });
-  auto dynamicStatesInfo =
-      vk::PipelineDynamicStateCreateInfo{}.setDynamicStates(dynamicStates);
-  auto rasterizationState =
-      vk::PipelineRasterizationStateCreateInfo{}.setLineWidth(1.0f);
-  auto viewportState =
-      vk::PipelineViewportStateCreateInfo{}.setViewportCount(1).setScissorCount(
-          1);
-  vk::PipelineMultisampleStateCreateInfo multisampleState{};
-  auto depthStencilState = vk::PipelineDepthStencilStateCreateInfo{}
-                               .setDepthTestEnable(true)
-                               .setDepthWriteEnable(true)
-                               .setDepthCompareOp(vk::CompareOp::eLess);
-  auto colorBlendingAttachments = std::to_array({
-      vk::PipelineColorBlendAttachmentState{}
-          .setBlendEnable(false)
-          .setColorWriteMask(
-              vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG |
-              vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA),
-  });
-  auto colorBlendState = vk::PipelineColorBlendStateCreateInfo{}.setAttachments(
-      colorBlendingAttachments);
-  auto pipeline = device
-                      .createGraphicsPipelineUnique(
-                          {}, vk::GraphicsPipelineCreateInfo{}
-                                  .setStages(stages)
-                                  .setPVertexInputState(&vertexInputInfo)
-                                  .setPInputAssemblyState(&inputAssemblyInfo)
-                                  .setPViewportState(&viewportState)
-                                  .setPRasterizationState(&rasterizationState)
-                                  .setPMultisampleState(&multisampleState)
-                                  .setPDepthStencilState(&depthStencilState)
-                                  .setPColorBlendState(&colorBlendState)
-                                  .setPDynamicState(&dynamicStatesInfo)
-                                  .setLayout(layout)
-                                  .setRenderPass(renderPass))
-                      .value;
-  return pipeline;
-}
+const auto kInstancedVertShaderPath =
+    "./assets/shaders/simple_instanced.vert.spv";
 
 SimpleMaterial SimpleMaterial::create(const GraphicsDevice &device,
                                       const RenderSystem &renderSystem,
+                                      BindlessHeap &bindlessHeap,
                                       glm::vec3 color,
-                                      std::optional<SimpleMaterial>) {
-  auto vkDevice = device.vkDevice();
-
-  auto poolSizes = std::to_array<vk::DescriptorPoolSize>({
-      {vk::DescriptorType::eUniformBuffer, 1},
-  });
-  auto descriptorPool = vkDevice.createDescriptorPoolUnique(
-      vk::DescriptorPoolCreateInfo{}.setMaxSets(1).setPoolSizes(poolSizes));
-
-  auto setBindings = std::to_array<vk::DescriptorSetLayoutBinding>({
-      {0, vk::DescriptorType::eUniformBuffer, 1,
-       vk::ShaderStageFlagBits::eFragment},
-  });
-  auto setLayout = vkDevice.createDescriptorSetLayoutUnique(
-      vk::DescriptorSetLayoutCreateInfo{}.setBindings(setBindings));
-  auto pushConstantRanges = std::to_array({vk::PushConstantRange{
-      kVertexAndFragmentStages, 0, sizeof(MeshUniforms)}});
-  static_assert(sizeof(MeshUniforms) < 128,
+                                      std::optional<SimpleMaterial> old) {
+  CPU_ZONE("create simple material");
+  static_assert(sizeof(InstanceData) <= BindlessHeap::kPushConstantSize,
                 "Push constant bigger than minimum guaranteed size.");
-  auto pipelineLayout = vkDevice.createPipelineLayoutUnique(
-      vk::PipelineLayoutCreateInfo{}
-          .setSetLayouts(setLayout.get())
-          .setPushConstantRanges(pushConstantRanges));
-
-  auto perMaterialUBO =
-      Buffer::createGPUOnly(device, PerMaterialUniforms{color},
-                            vk::BufferUsageFlagBits::eUniformBuffer);
-  auto perMaterialDescriptorSet = vkDevice.allocateDescriptorSets(
-      vk::DescriptorSetAllocateInfo{}
-          .setSetLayouts(setLayout.get())
-          .setDescriptorPool(descriptorPool.get()))[0];
-  auto perMaterialUBOInfo = vk::DescriptorBufferInfo{}
-                                .setBuffer(perMaterialUBO.vkBuffer())
-                                .setRange(vk::WholeSize);
-  auto descriptorWrites = std::to_array({
-      vk::WriteDescriptorSet{}
-          .setDstSet(perMaterialDescriptorSet)
-          .setDstBinding(0)
-          .setDescriptorCount(1)
-          .setDescriptorType(vk::DescriptorType::eUniformBuffer)
-          .setBufferInfo(perMaterialUBOInfo),
-  });
-  vkDevice.updateDescriptorSets(descriptorWrites, {});
-
-  auto shaderModules = std::to_array({
-      loadShaderFromPath(kVertShaderPath, vkDevice),
-      loadShaderFromPath(kFragShaderPath, vkDevice),
-  });
-  auto pipeline = createPipeline(pipelineLayout.get(), shaderModules,
-                                 renderSystem.vkRenderPass(), vkDevice);
+  auto pipelineLayout = renderSystem.bindlessHeap().vkPipelineLayout();
+
+  MaterialParameters parameters{glm::vec4{color, 1.0f}, {}};
+  MaterialIndex materialIndex;
+  if (old.has_value()) {
+    materialIndex = old->_materialIndex;
+    bindlessHeap.setMaterial(device, materialIndex, parameters);
+  } else {
+    materialIndex = bindlessHeap.addMaterial(device, parameters);
+  }
+
+  PipelineDesc desc;
+  desc.vertexShader = kVertShaderPath;
+  desc.fragmentShader = kFragShaderPath;
+  desc.layout = pipelineLayout;
+  desc.setTargets(renderSystem.pipelineRenderingInfo());
+  auto pipelines = requestMaterialPipelines<Vertex>(
+      device.pipelines(), std::move(desc), kInstancedVertShaderPath);
+
+  return {pipelineLayout, materialIndex, pipelines};
+}
 
-  return {std::move(descriptorPool), std::move(setLayout),
-          std::move(pipelineLayout), std::move(perMaterialUBO),
-          perMaterialDescriptorSet,  std::move(shaderModules),
-          std::move(pipeline)};
+void SimpleMaterial::bind(const Frame &, vk::CommandBuffer cmd,
+                          bool instanced, FrameAllocator &) const {
+  cmd.bindPipeline(vk::PipelineBindPoint::eGraphics,
+                   _pipelines.vkPipeline(instanced));
 }
 
-void SimpleMaterial::render(const Frame &, vk::CommandBuffer cmd,
-                            const MeshUniforms &meshUniforms,
-                            vk::Buffer vertexBuffer, vk::Buffer indexBuffer,
-                            uint32_t indexCount) const {
-  cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, _vkPipeline.get());
-  cmd.pushConstants<MeshUniforms>(_vkPipelineLayout.get(),
-                                  kVertexAndFragmentStages, 0, meshUniforms);
-  cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics,
-                         _vkPipelineLayout.get(), 0, _perMaterialDescriptorSet,
-                         {});
-  cmd.bindVertexBuffers(0, vertexBuffer, {0});
-  cmd.bindIndexBuffer(indexBuffer, 0, vk::IndexType::eUint16);
-  cmd.drawIndexed(indexCount, 1, 0, 0, 0);
+void SimpleMaterial::pushMeshUniforms(vk::CommandBuffer cmd,
+                                      const InstanceData &instance) const {
+  cmd.pushConstants<InstanceData>(_vkPipelineLayout, kVertexAndFragmentStages,
+                                  0, instance);
 }
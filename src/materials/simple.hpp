@@ -5,34 +5,23 @@
 
 #include <glm/glm.hpp>
 
-#include "../buffer.hpp"
+#include "../bindless_heap.hpp"
 #include "../material.hpp"
 
 struct GraphicsDevice;
 struct RenderSystem;
 struct SimpleMaterial : public Material {
-  SimpleMaterial(vk::UniqueDescriptorPool vkDescriptorPool,
-                 vk::UniqueDescriptorSetLayout vkSetLayout,
-                 vk::UniquePipelineLayout vkPipelineLayout,
-                 Buffer perMaterialUBO,
-                 vk::DescriptorSet perMaterialDescriptorSet,
-                 std::array<vk::UniqueShaderModule, 2> vkShaderModules,
-                 vk::UniquePipeline vkPipeline)
-      : _vkDescriptorPool(std::move(vkDescriptorPool)),
-        _vkSetLayout(std::move(vkSetLayout)),
-        _vkPipelineLayout(std::move(vkPipelineLayout)),
-        _perMaterialUBO(std::move(perMaterialUBO)),
-        _perMaterialDescriptorSet(perMaterialDescriptorSet),
-        _vkShaderModules(std::move(vkShaderModules)),
-        _vkPipeline(std::move(vkPipeline)) {}
+  SimpleMaterial(vk::PipelineLayout vkPipelineLayout,
+                 MaterialIndex materialIndex, MaterialPipelines pipelines)
+      : _vkPipelineLayout(vkPipelineLayout), _materialIndex(materialIndex),
+        _pipelines(pipelines) {}
 
+  // The color is stored in `bindlessHeap`, which must be the render system's.
+  // A recreated material keeps the slot of `old`.
   static SimpleMaterial
   create(const GraphicsDevice &device, const RenderSystem &renderSystem,
-         glm::vec3 color, std::optional<SimpleMaterial> old = std::nullopt);
-
-  struct PerMaterialUniforms {
-    glm::vec3 color;
-  };
+         BindlessHeap &bindlessHeap, glm::vec3 color,
+         std::optional<SimpleMaterial> old = std::nullopt);
 
   struct Vertex {
     glm::vec3 position;
@@ -46,16 +35,19 @@ struct SimpleMaterial : public Material {
     });
   };
 
-  void render(const Frame &frame, vk::CommandBuffer cmd,
-              const MeshUniforms &meshUniforms, vk::Buffer vertexBuffer,
-              vk::Buffer indexBuffer, uint32_t indexCount) const;
+  inline vk::Pipeline vkPipeline() const { return _pipelines.vkPipeline(); }
+  inline const MaterialPipelines &pipelines() const { return _pipelines; }
+  inline MaterialIndex materialIndex() const { return _materialIndex; }
+  inline std::string_view name() const { return "simple"; }
+  void bind(const Frame &frame, vk::CommandBuffer cmd, bool instanced,
+            FrameAllocator &frameAllocator) const;
+  void pushMeshUniforms(vk::CommandBuffer cmd,
+                        const InstanceData &instance) const;
 
 private:
-  vk::UniqueDescriptorPool _vkDescriptorPool;
-  vk::UniqueDescriptorSetLayout _vkSetLayout;
-  vk::UniquePipelineLayout _vkPipelineLayout;
-  Buffer _perMaterialUBO;
-  vk::DescriptorSet _perMaterialDescriptorSet;
-  std::array<vk::UniqueShaderModule, 2> _vkShaderModules;
-  vk::UniquePipeline _vkPipeline;
+  // Owned by the `BindlessHeap`
+  vk::PipelineLayout _vkPipelineLayout;
+  MaterialIndex _materialIndex;
+  // Owned by the device's `PipelineRegistry`
+  MaterialPipelines _pipelines;
 };
@@ -1,9 +1,36 @@
 #pragma once
 
+#include <string_view>
+
 #include "vulkan/vulkan.hpp"
 
+#include "../material.hpp"
+#include "../pipeline_registry.hpp"
+
 vk::UniqueShaderModule loadShaderFromPath(const std::string_view path,
                                           vk::Device device);
 
 const vk::ShaderStageFlags kVertexAndFragmentStages =
     vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment;
+
+// Requests the plain and instanced variants of a material pipeline drawing
+// meshes of `TVertex`. They share everything in `desc` but the vertex shader
+// and the vertex layout.
+template <class TVertex>
+MaterialPipelines
+requestMaterialPipelines(PipelineRegistry &registry, PipelineDesc desc,
+                         std::string_view instancedVertShaderPath) {
+  desc.vertexBindings.assign(TVertex::kBindings.begin(),
+                             TVertex::kBindings.end());
+  desc.vertexAttributes.assign(TVertex::kAttributes.begin(),
+                               TVertex::kAttributes.end());
+  auto instancedDesc = desc;
+  instancedDesc.vertexShader = instancedVertShaderPath;
+  instancedDesc.vertexBindings.assign(
+      InstancedVertex<TVertex>::kBindings.begin(),
+      InstancedVertex<TVertex>::kBindings.end());
+  instancedDesc.vertexAttributes.assign(
+      InstancedVertex<TVertex>::kAttributes.begin(),
+      InstancedVertex<TVertex>::kAttributes.end());
+  return {registry.request(desc), registry.request(instancedDesc)};
+}
@@ -0,0 +1,20 @@
+#include "mesh_pool.hpp"
+
+#include "graphics_device.hpp"
+
+MeshPool MeshPool::create(const GraphicsDevice &device,
+                          vk::DeviceSize vertexCapacity,
+                          uint32_t indexCapacity) {
+  auto vertexBuffer = Buffer::create(
+      device,
+      vk::BufferUsageFlagBits::eVertexBuffer |
+          vk::BufferUsageFlagBits::eTransferDst,
+      vma::MemoryUsage::eGpuOnly, vertexCapacity);
+  auto indexBuffer = Buffer::create(
+      device,
+      vk::BufferUsageFlagBits::eIndexBuffer |
+          vk::BufferUsageFlagBits::eTransferDst,
+      vma::MemoryUsage::eGpuOnly, indexCapacity * sizeof(uint16_t));
+  return {std::move(vertexBuffer), std::move(indexBuffer), vertexCapacity,
+          indexCapacity};
+}
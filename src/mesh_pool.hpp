@@ -0,0 +1,35 @@
+#pragma once
+
+#include <ranges>
+
+#include <vulkan/vulkan.hpp>
+
+#include "buffer.hpp"
+#include "model.hpp"
+
+struct GraphicsDevice;
+// Fixed-capacity vertex and index buffers shared by many meshes. Draws of
+// meshes from the same pool only differ in their index/vertex offsets, so
+// they can be submitted together with a single indirect draw.
+struct MeshPool {
+  MeshPool(Buffer vertexBuffer, Buffer indexBuffer,
+           vk::DeviceSize vertexCapacity, uint32_t indexCapacity)
+      : _vertexBuffer(std::move(vertexBuffer)),
+        _indexBuffer(std::move(indexBuffer)), _vertexCapacity(vertexCapacity),
+        _indexCapacity(indexCapacity) {}
+
+  static MeshPool create(const GraphicsDevice &device,
+                         vk::DeviceSize vertexCapacity, uint32_t indexCapacity);
+
+  template <std::ranges::range TVRange, std::ranges::range TIRange>
+  MeshRange add(const GraphicsDevice &device, const TVRange &vertices,
+                const TIRange &indices);
+
+private:
+  Buffer _vertexBuffer;
+  Buffer _indexBuffer;
+  vk::DeviceSize _vertexCapacity;
+  vk::DeviceSize _vertexSize = 0;
+  uint32_t _indexCapacity;
+  uint32_t _indexCount = 0;
+};
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "mesh_pool.hpp"
+
+#include <stdexcept>
+
+#include "buffer_impl.hpp"
+
+template <std::ranges::range TVRange, std::ranges::range TIRange>
+MeshRange MeshPool::add(const GraphicsDevice &device, const TVRange &vertices,
+                        const TIRange &indices) {
+  using TVertex = std::ranges::range_value_t<TVRange>;
+  using TIndex = std::ranges::range_value_t<TIRange>;
+  static_assert(std::is_same_v<TIndex, uint16_t>,
+                "Only 16-bit unsigned integers can be used as indexes.");
+
+  // Vertex offsets are counted in vertices, so meshes of different vertex
+  // types need their first vertex aligned to their own stride.
+  const vk::DeviceSize stride = sizeof(TVertex);
+  const vk::DeviceSize firstVertex = (_vertexSize + stride - 1) / stride;
+  const vk::DeviceSize vertexEnd =
+      (firstVertex + std::ranges::size(vertices)) * stride;
+  const auto indexCount = static_cast<uint32_t>(std::ranges::size(indices));
+  if (vertexEnd > _vertexCapacity ||
+      _indexCount + indexCount > _indexCapacity) {
+    throw std::runtime_error("mesh pool is full");
+  }
+
+  _vertexBuffer.uploadRange(device, vertices, firstVertex * stride);
+  _indexBuffer.uploadRange(device, indices, _indexCount * sizeof(TIndex));
+  MeshRange range{_vertexBuffer.vkBuffer(), _indexBuffer.vkBuffer(), indexCount,
+                  _indexCount, static_cast<int32_t>(firstVertex)};
+  _vertexSize = vertexEnd;
+  _indexCount += indexCount;
+  return range;
+}
@@ -2,26 +2,65 @@
 
 #include "buffer.hpp"
 
+#include <optional>
 #include <ranges>
 
 #include <vulkan/vulkan.hpp>
 
+#include <glm/glm.hpp>
+
+// Where a mesh lives inside vertex/index buffers that may be shared with other
+// meshes (see `MeshPool`).
+struct MeshRange {
+  vk::Buffer vertexBuffer;
+  vk::Buffer indexBuffer;
+  uint32_t indexCount;
+  uint32_t firstIndex;
+  int32_t vertexOffset;
+
+  bool operator==(const MeshRange &) const = default;
+};
+
+// Bounding sphere of a mesh, in model space.
+struct BoundingSphere {
+  glm::vec3 center;
+  float radius;
+
+  // Centered on the vertices' bounding box, which is close enough to the
+  // smallest sphere for culling.
+  template <std::ranges::range TVRange>
+  static BoundingSphere fromVertices(const TVRange &vertices);
+};
+
 struct GraphicsDevice;
+struct MeshPool;
 struct Model {
-  Model(Buffer vertexBuffer, Buffer indexBuffer, uint32_t indexCount)
-      : _vertexBuffer(std::move(vertexBuffer)),
-        _indexBuffer(std::move(indexBuffer)), _indexCount(indexCount) {}
+  Model(Buffer vertexBuffer, Buffer indexBuffer, uint32_t indexCount,
+        BoundingSphere bounds)
+      : _range{vertexBuffer.vkBuffer(), indexBuffer.vkBuffer(), indexCount, 0,
+               0},
+        _bounds(bounds), _vertexBuffer(std::move(vertexBuffer)),
+        _indexBuffer(std::move(indexBuffer)) {}
+  Model(MeshRange range, BoundingSphere bounds)
+      : _range(range), _bounds(bounds) {}
 
+  // Uploads the mesh into its own vertex and index buffers.
   template <std::ranges::range TVRange, std::ranges::range TIRange>
   static Model fromRanges(const GraphicsDevice &device, TVRange vertices,
                           TIRange indices);
+  // Uploads the mesh into `pool`, which must outlive the model.
+  template <std::ranges::range TVRange, std::ranges::range TIRange>
+  static Model fromRanges(const GraphicsDevice &device, MeshPool &pool,
+                          TVRange vertices, TIRange indices);
 
-  inline const Buffer &vertexBuffer() const { return _vertexBuffer; }
-  inline const Buffer &indexBuffer() const { return _indexBuffer; }
-  inline uint32_t indexCount() const { return _indexCount; }
+  inline const MeshRange &range() const { return _range; }
+  inline uint32_t indexCount() const { return _range.indexCount; }
+  inline const BoundingSphere &bounds() const { return _bounds; }
 
 private:
-  Buffer _vertexBuffer;
-  Buffer _indexBuffer;
-  uint32_t _indexCount;
+  MeshRange _range;
+  BoundingSphere _bounds;
+  // Only set when the model owns its buffers.
+  std::optional<Buffer> _vertexBuffer;
+  std::optional<Buffer> _indexBuffer;
 };
@@ -2,6 +2,31 @@
 
 #include "model.hpp"
 
+#include <algorithm>
+#include <limits>
+
+#include "mesh_pool.hpp"
+#include "mesh_pool_impl.hpp"
+
+template <std::ranges::range TVRange>
+BoundingSphere BoundingSphere::fromVertices(const TVRange &vertices) {
+  if (std::ranges::empty(vertices)) {
+    return {glm::vec3{0.0f}, 0.0f};
+  }
+  glm::vec3 min{std::numeric_limits<float>::max()};
+  glm::vec3 max{std::numeric_limits<float>::lowest()};
+  for (const auto &vertex : vertices) {
+    min = glm::min(min, vertex.position);
+    max = glm::max(max, vertex.position);
+  }
+  auto center = (min + max) * 0.5f;
+  float radius = 0.0f;
+  for (const auto &vertex : vertices) {
+    radius = std::max(radius, glm::distance(center, vertex.position));
+  }
+  return {center, radius};
+}
+
 template <std::ranges::range TVRange, std::ranges::range TIRange>
 Model Model::fromRanges(const GraphicsDevice &device, TVRange vertices,
                         TIRange indices) {
@@ -13,5 +38,13 @@ Model Model::fromRanges(const GraphicsDevice &device, TVRange vertices,
       device, vertices, vk::BufferUsageFlagBits::eVertexBuffer);
   auto indexBuffer = Buffer::createGPUOnlyArray(
       device, indices, vk::BufferUsageFlagBits::eIndexBuffer);
-  return {std::move(vertexBuffer), std::move(indexBuffer), indexCount};
+  return {std::move(vertexBuffer), std::move(indexBuffer), indexCount,
+          BoundingSphere::fromVertices(vertices)};
+}
+
+template <std::ranges::range TVRange, std::ranges::range TIRange>
+Model Model::fromRanges(const GraphicsDevice &device, MeshPool &pool,
+                        TVRange vertices, TIRange indices) {
+  return {pool.add(device, vertices, indices),
+          BoundingSphere::fromVertices(vertices)};
 }
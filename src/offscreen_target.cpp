@@ -0,0 +1,39 @@
+#include "offscreen_target.hpp"
+
+#include <ranges>
+
+#include <vulkan/vulkan.hpp>
+
+#include "graphics_device.hpp"
+#include "timeline.hpp"
+
+OffscreenTarget OffscreenTarget::create(const GraphicsDevice &device,
+                                        vk::Extent2D extent,
+                                        size_t framesInFlight,
+                                        vk::Format format) {
+  checkFramesInFlight(framesInFlight);
+  // One image per frame in flight: waiting for the previous frame of an index
+  // then also frees its image.
+  auto images =
+      std::views::iota(static_cast<size_t>(0), framesInFlight) |
+      std::views::transform([&](auto) {
+        return Texture2D::create(device, extent, format,
+                                 vk::ImageUsageFlagBits::eColorAttachment |
+                                     vk::ImageUsageFlagBits::eTransferSrc,
+                                 vma::MemoryUsage::eGpuOnly);
+      }) |
+      std::ranges::to<std::vector<Texture2D>>();
+  return {device.graphicsTimeline(), extent, format, std::move(images)};
+}
+
+std::optional<Frame> OffscreenTarget::nextImage() {
+  auto index = _frame;
+  _frame = static_cast<FrameIndex>((_frame + 1) % framesInFlight());
+  _timeline->wait(_frameValues[index]);
+  return {{index, index, nullptr, nullptr, 0, {}}};
+}
+
+void OffscreenTarget::present(Frame frame) {
+  _frameValues[frame.index] = frame.timelineValue;
+  _presentedFrames++;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <array>
+#include <optional>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+#include "render_target.hpp"
+#include "textures.hpp"
+
+struct GraphicsDevice;
+struct Timeline;
+// Render target backed by plain device images instead of a swapchain, so the
+// whole frame path can run without a window or a presentation engine.
+// `present` only retires the frame; images are left in transfer-source layout
+// for whoever wants to read them back.
+struct OffscreenTarget : public RenderTarget {
+  const static vk::Format kDefaultFormat = vk::Format::eR8G8B8A8Unorm;
+
+  OffscreenTarget(Timeline &timeline, vk::Extent2D extent, vk::Format format,
+                  std::vector<Texture2D> images)
+      : _timeline(&timeline), _extent(extent), _format(format),
+        _images(std::move(images)) {}
+
+  static OffscreenTarget
+  create(const GraphicsDevice &device, vk::Extent2D extent,
+         size_t framesInFlight = kDefaultConcurrentFrames,
+         vk::Format format = kDefaultFormat);
+
+  std::optional<Frame> nextImage();
+  void present(Frame frame);
+
+  // One image per frame in flight.
+  inline size_t framesInFlight() const { return _images.size(); }
+  inline vk::Extent2D extent() const { return _extent; }
+  inline vk::Format format() const { return _format; }
+  inline size_t imageCount() const { return _images.size(); }
+  inline vk::Image image(ImageIndex image) const {
+    return _images[image].vkImage();
+  }
+  inline vk::ImageView imageView(ImageIndex image) const {
+    return _images[image].vkImageView();
+  }
+  inline vk::ImageLayout finalLayout() const {
+    return vk::ImageLayout::eTransferSrcOptimal;
+  }
+  inline bool needsRecreation() const { return false; }
+  inline uint64_t presentedFrames() const { return _presentedFrames; }
+
+private:
+  Timeline *_timeline;
+  vk::Extent2D _extent;
+  vk::Format _format;
+  std::vector<Texture2D> _images;
+  // Graphics timeline value of the last frame of each index
+  std::array<uint64_t, kMaxConcurrentFrames> _frameValues{};
+  FrameIndex _frame = 0;
+  uint64_t _presentedFrames = 0;
+};
@@ -0,0 +1,219 @@
+#include "pipeline_registry.hpp"
+
+#include <array>
+#include <chrono>
+#include <functional>
+#include <type_traits>
+
+#include "materials/utils.hpp"
+
+static void hashCombine(size_t &seed, size_t value) {
+  seed ^= value + 0x9e3779b97f4a7c15 + (seed << 6) + (seed >> 2);
+}
+
+template <class T> static size_t hashOf(const T &value) {
+  return std::hash<T>{}(value);
+}
+
+template <class TEnum> static size_t hashOfEnum(TEnum value) {
+  return hashOf(static_cast<std::underlying_type_t<TEnum>>(value));
+}
+
+PipelineDesc &
+PipelineDesc::setTargets(const vk::PipelineRenderingCreateInfo &renderingInfo) {
+  colorFormats.assign(renderingInfo.pColorAttachmentFormats,
+                      renderingInfo.pColorAttachmentFormats +
+                          renderingInfo.colorAttachmentCount);
+  depthFormat = renderingInfo.depthAttachmentFormat;
+  return *this;
+}
+
+size_t PipelineDescHash::operator()(const PipelineDesc &desc) const {
+  size_t seed = 0;
+  hashCombine(seed, hashOf(desc.vertexShader));
+  hashCombine(seed, hashOf(desc.fragmentShader));
+  for (const auto &binding : desc.vertexBindings) {
+    hashCombine(seed, hashOf(binding.binding));
+    hashCombine(seed, hashOf(binding.stride));
+    hashCombine(seed, hashOfEnum(binding.inputRate));
+  }
+  for (const auto &attribute : desc.vertexAttributes) {
+    hashCombine(seed, hashOf(attribute.location));
+    hashCombine(seed, hashOf(attribute.binding));
+    hashCombine(seed, hashOfEnum(attribute.format));
+    hashCombine(seed, hashOf(attribute.offset));
+  }
+  hashCombine(seed, hashOfEnum(desc.topology));
+  hashCombine(seed, hashOf(static_cast<VkCullModeFlags>(desc.cullMode)));
+  hashCombine(seed, hashOfEnum(desc.frontFace));
+  hashCombine(seed, hashOf(desc.depthTest));
+  hashCombine(seed, hashOf(desc.depthWrite));
+  hashCombine(seed, hashOfEnum(desc.depthCompareOp));
+  hashCombine(seed, hashOfEnum(desc.blend));
+  for (auto format : desc.colorFormats) {
+    hashCombine(seed, hashOfEnum(format));
+  }
+  hashCombine(seed, hashOfEnum(desc.depthFormat));
+  hashCombine(seed, hashOf(desc.layout));
+  return seed;
+}
+
+vk::Pipeline PipelineHandle::get() const {
+  if (!ready()) {
+    return nullptr;
+  }
+  if (_entry->error) {
+    std::rethrow_exception(_entry->error);
+  }
+  return _entry->pipeline.get();
+}
+
+vk::Pipeline PipelineHandle::wait() const {
+  _entry->ready.wait(false, std::memory_order_acquire);
+  return get();
+}
+
+// Compilation is mostly driver work, a couple of threads keep it off the
+// frame without competing much with recording.
+const size_t kCompileThreadCount = 2;
+
+PipelineRegistry::PipelineRegistry(vk::Device device,
+                                   vk::PipelineCache pipelineCache)
+    : _device(device), _pipelineCache(pipelineCache),
+      _workers(kCompileThreadCount) {}
+
+PipelineHandle PipelineRegistry::request(const PipelineDesc &desc) {
+  std::scoped_lock lock{_mutex};
+  auto it = _pipelines.find(desc);
+  if (it != _pipelines.end()) {
+    _stats.hits++;
+    return PipelineHandle{it->second.get()};
+  }
+  _stats.misses++;
+  it = _pipelines.emplace(desc, std::make_unique<Entry>()).first;
+  it->second->desc = &it->first;
+  // Map nodes are never moved, so the task can refer to the stored key.
+  _workers.submit([this, &storedDesc = it->first, &entry = *it->second] {
+    compile(storedDesc, entry);
+  });
+  return PipelineHandle{it->second.get()};
+}
+
+void PipelineRegistry::waitIdle() {
+  std::vector<PipelineHandle> handles;
+  {
+    std::scoped_lock lock{_mutex};
+    for (const auto &[desc, entry] : _pipelines) {
+      handles.push_back(PipelineHandle{entry.get()});
+    }
+  }
+  for (const auto &handle : handles) {
+    handle.wait();
+  }
+}
+
+PipelineRegistry::Stats PipelineRegistry::stats() {
+  std::scoped_lock lock{_mutex};
+  return _stats;
+}
+
+void PipelineRegistry::compile(const PipelineDesc &desc, Entry &entry) {
+  auto start = std::chrono::steady_clock::now();
+  try {
+    entry.pipeline = create(desc);
+  } catch (...) {
+    entry.error = std::current_exception();
+  }
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  {
+    std::scoped_lock lock{_mutex};
+    _stats.compiled++;
+    _stats.compileTime += elapsed;
+  }
+  entry.ready.store(true, std::memory_order_release);
+  entry.ready.notify_all();
+}
+
+vk::ShaderModule PipelineRegistry::shaderModule(const std::string &path) {
+  // Loading under the lock keeps a module from being loaded twice; it is
+  // cheap next to compiling the pipeline.
+  std::scoped_lock lock{_mutex};
+  auto it = _shaderModules.find(path);
+  if (it == _shaderModules.end()) {
+    it = _shaderModules.emplace(path, loadShaderFromPath(path, _device)).first;
+  }
+  return it->second.get();
+}
+
+vk::UniquePipeline PipelineRegistry::create(const PipelineDesc &desc) {
+  auto stages = std::to_array({
+      vk::PipelineShaderStageCreateInfo{{},
+                                        vk::ShaderStageFlagBits::eVertex,
+                                        shaderModule(desc.vertexShader),
+                                        "main"},
+      vk::PipelineShaderStageCreateInfo{{},
+                                        vk::ShaderStageFlagBits::eFragment,
+                                        shaderModule(desc.fragmentShader),
+                                        "main"},
+  });
+  vk::PipelineVertexInputStateCreateInfo vertexInputInfo{
+      {}, desc.vertexBindings, desc.vertexAttributes};
+  vk::PipelineInputAssemblyStateCreateInfo inputAssemblyInfo{{},
+                                                             desc.topology};
+  auto dynamicStates = std::to_array({
+      vk::DynamicState::eViewport,
+      vk::DynamicState::eScissor,
+  });
+  auto dynamicStatesInfo =
+      vk::PipelineDynamicStateCreateInfo{}.setDynamicStates(dynamicStates);
+  auto rasterizationState = vk::PipelineRasterizationStateCreateInfo{}
+                                .setCullMode(desc.cullMode)
+                                .setFrontFace(desc.frontFace)
+                                .setLineWidth(1.0f);
+  auto viewportState =
+      vk::PipelineViewportStateCreateInfo{}.setViewportCount(1).setScissorCount(
+          1);
+  vk::PipelineMultisampleStateCreateInfo multisampleState{};
+  auto depthStencilState = vk::PipelineDepthStencilStateCreateInfo{}
+                               .setDepthTestEnable(desc.depthTest)
+                               .setDepthWriteEnable(desc.depthWrite)
+                               .setDepthCompareOp(desc.depthCompareOp);
+  bool additive = desc.blend == BlendMode::eAdditive;
+  std::vector<vk::PipelineColorBlendAttachmentState> colorBlendingAttachments(
+      desc.colorFormats.size(),
+      vk::PipelineColorBlendAttachmentState{}
+          .setBlendEnable(desc.blend != BlendMode::eNone)
+          .setSrcColorBlendFactor(additive ? vk::BlendFactor::eOne
+                                           : vk::BlendFactor::eSrcAlpha)
+          .setDstColorBlendFactor(additive ? vk::BlendFactor::eOne
+                                           : vk::BlendFactor::eOneMinusSrcAlpha)
+          .setColorBlendOp(vk::BlendOp::eAdd)
+          .setSrcAlphaBlendFactor(vk::BlendFactor::eOne)
+          .setDstAlphaBlendFactor(vk::BlendFactor::eZero)
+          .setAlphaBlendOp(vk::BlendOp::eAdd)
+          .setColorWriteMask(
+              vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG |
+              vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA));
+  auto colorBlendState = vk::PipelineColorBlendStateCreateInfo{}.setAttachments(
+      colorBlendingAttachments);
+  auto renderingInfo = vk::PipelineRenderingCreateInfo{}
+                           .setColorAttachmentFormats(desc.colorFormats)
+                           .setDepthAttachmentFormat(desc.depthFormat);
+  auto pipeline = _device
+                      .createGraphicsPipelineUnique(
+                          _pipelineCache,
+                          vk::GraphicsPipelineCreateInfo{}
+                              .setPNext(&renderingInfo)
+                              .setStages(stages)
+                              .setPVertexInputState(&vertexInputInfo)
+                              .setPInputAssemblyState(&inputAssemblyInfo)
+                              .setPViewportState(&viewportState)
+                              .setPRasterizationState(&rasterizationState)
+                              .setPMultisampleState(&multisampleState)
+                              .setPDepthStencilState(&depthStencilState)
+                              .setPColorBlendState(&colorBlendState)
+                              .setPDynamicState(&dynamicStatesInfo)
+                              .setLayout(desc.layout))
+                      .value;
+  return pipeline;
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+#include "thread_pool.hpp"
+
+enum class BlendMode {
+  eNone,
+  // Standard alpha blending
+  eAlpha,
+  // Colors add up, e.g. to count overlapping fragments
+  eAdditive,
+};
+
+// Everything a graphics pipeline is built from. Shaders are named by path
+// rather than by module, so descriptions built independently (e.g. by two
+// materials) compare equal when they would produce the same pipeline.
+// Viewport and scissor are always dynamic.
+struct PipelineDesc {
+  std::string vertexShader;
+  std::string fragmentShader;
+  std::vector<vk::VertexInputBindingDescription> vertexBindings;
+  std::vector<vk::VertexInputAttributeDescription> vertexAttributes;
+  vk::PrimitiveTopology topology = vk::PrimitiveTopology::eTriangleList;
+  vk::CullModeFlags cullMode = vk::CullModeFlagBits::eBack;
+  vk::FrontFace frontFace = vk::FrontFace::eCounterClockwise;
+  bool depthTest = true;
+  bool depthWrite = true;
+  vk::CompareOp depthCompareOp = vk::CompareOp::eLess;
+  // Applies to every color attachment.
+  BlendMode blend = BlendMode::eNone;
+  std::vector<vk::Format> colorFormats;
+  vk::Format depthFormat = vk::Format::eUndefined;
+  vk::PipelineLayout layout;
+
+  // Takes the attachment formats of `renderingInfo`.
+  PipelineDesc &
+  setTargets(const vk::PipelineRenderingCreateInfo &renderingInfo);
+
+  bool operator==(const PipelineDesc &) const = default;
+};
+
+struct PipelineDescHash {
+  size_t operator()(const PipelineDesc &desc) const;
+};
+
+struct PipelineRegistry;
+// Pipeline that may still be compiling in the background. Cheap to copy, and
+// valid as long as the registry it came from.
+struct PipelineHandle {
+  // Null until the pipeline is ready. Rethrows the compilation error, if any.
+  vk::Pipeline get() const;
+  inline bool ready() const {
+    return _entry->ready.load(std::memory_order_acquire);
+  }
+  // What the pipeline is built from, e.g. to request a variant of it.
+  inline const PipelineDesc &desc() const { return *_entry->desc; }
+  // Blocks until the pipeline is ready.
+  vk::Pipeline wait() const;
+
+private:
+  friend struct PipelineRegistry;
+  struct Entry {
+    // Key of the entry in the registry
+    const PipelineDesc *desc = nullptr;
+    vk::UniquePipeline pipeline;
+    std::exception_ptr error;
+    std::atomic<bool> ready = false;
+  };
+
+  explicit PipelineHandle(const Entry *entry) : _entry(entry) {}
+
+  const Entry *_entry;
+};
+
+// Device-wide cache of graphics pipelines and shader modules. Requesting a
+// description that was requested before returns the same pipeline, so
+// identical materials never compile twice. New pipelines are compiled on
+// worker threads, so requesting them never blocks. Pipelines and modules live
+// as long as the registry. Safe to use from several threads.
+struct PipelineRegistry {
+  struct Stats {
+    // Requests answered with an existing pipeline
+    uint64_t hits;
+    // Requests that created a pipeline
+    uint64_t misses;
+    // Pipelines done compiling, successfully or not
+    uint64_t compiled;
+    // Time spent compiling on the workers, summed over pipelines
+    std::chrono::duration<float, std::milli> compileTime;
+  };
+
+  PipelineRegistry(vk::Device device, vk::PipelineCache pipelineCache);
+  PipelineRegistry(const PipelineRegistry &) = delete;
+  PipelineRegistry &operator=(const PipelineRegistry &) = delete;
+
+  // Returns right away; the pipeline is compiled in the background unless it
+  // was requested before.
+  PipelineHandle request(const PipelineDesc &desc);
+  // Like `request`, but waits for the pipeline to be ready.
+  inline vk::Pipeline get(const PipelineDesc &desc) {
+    return request(desc).wait();
+  }
+  // Blocks until every pipeline requested so far is ready.
+  void waitIdle();
+  Stats stats();
+
+private:
+  using Entry = PipelineHandle::Entry;
+
+  vk::ShaderModule shaderModule(const std::string &path);
+  vk::UniquePipeline create(const PipelineDesc &desc);
+  void compile(const PipelineDesc &desc, Entry &entry);
+
+  vk::Device _device;
+  vk::PipelineCache _pipelineCache;
+  std::mutex _mutex;
+  std::unordered_map<std::string, vk::UniqueShaderModule> _shaderModules;
+  // Entries are never moved, so handles can point at them.
+  std::unordered_map<PipelineDesc, std::unique_ptr<Entry>, PipelineDescHash>
+      _pipelines;
+  Stats _stats{};
+  // Last, so compilations in progress finish before anything goes away.
+  ThreadPool _workers;
+};
@@ -1,171 +1,403 @@
 #include "render_system.hpp"
 
+#include <algorithm>
 #include <array>
 #include <ranges>
+#include <span>
+#include <stdexcept>
 
+#include "buffer_impl.hpp"
+#include "cpu_profiler.hpp"
+#include "draw_queue.hpp"
 #include "graphics_device.hpp"
 #include "material.hpp"
-#include "model.hpp"
-#include "swapchain.hpp"
-
-vk::UniqueRenderPass createRenderPass(vk::Device device,
-                                      vk::Format swapchainFormat,
-                                      vk::Format depthFormat) {
-  auto attachments = std::to_array({
-      vk::AttachmentDescription{}
-          .setFormat(swapchainFormat)
-          .setLoadOp(vk::AttachmentLoadOp::eClear)
-          .setStoreOp(vk::AttachmentStoreOp::eStore)
-          .setStencilLoadOp(vk::AttachmentLoadOp::eDontCare)
-          .setStencilStoreOp(vk::AttachmentStoreOp::eDontCare)
-          .setInitialLayout(vk::ImageLayout::eUndefined)
-          .setFinalLayout(vk::ImageLayout::ePresentSrcKHR),
-      vk::AttachmentDescription{}
-          .setFormat(depthFormat)
-          .setLoadOp(vk::AttachmentLoadOp::eClear)
-          .setStoreOp(vk::AttachmentStoreOp::eDontCare)
-          .setStencilLoadOp(vk::AttachmentLoadOp::eDontCare)
-          .setStencilStoreOp(vk::AttachmentStoreOp::eDontCare)
-          .setInitialLayout(vk::ImageLayout::eUndefined)
-          .setFinalLayout(vk::ImageLayout::eDepthStencilAttachmentOptimal),
-  });
-  auto attachmentsRefs = std::to_array({
-      vk::AttachmentReference{0, vk::ImageLayout::eColorAttachmentOptimal},
-      vk::AttachmentReference{1,
-                              vk::ImageLayout::eDepthStencilAttachmentOptimal},
-  });
-  auto subpasses = std::to_array({
-      vk::SubpassDescription{}
-          .setPipelineBindPoint(vk::PipelineBindPoint::eGraphics)
-          .setColorAttachments(attachmentsRefs[0])
-          .setPDepthStencilAttachment(&attachmentsRefs[1]),
-  });
-  auto subpassDependencies = std::to_array({
-      vk::SubpassDependency{}
-          .setSrcSubpass(vk::SubpassExternal)
-          .setDstSubpass(0)
-          .setSrcStageMask(vk::PipelineStageFlagBits::eColorAttachmentOutput |
-                           vk::PipelineStageFlagBits::eEarlyFragmentTests)
-          .setDstStageMask(vk::PipelineStageFlagBits::eColorAttachmentOutput |
-                           vk::PipelineStageFlagBits::eEarlyFragmentTests)
-          .setDstAccessMask(vk::AccessFlagBits::eColorAttachmentWrite |
-                            vk::AccessFlagBits::eDepthStencilAttachmentWrite),
-  });
-  return device.createRenderPassUnique(vk::RenderPassCreateInfo{
-      {}, attachments, subpasses, subpassDependencies});
+#include "render_target.hpp"
+#include "thread_pool_impl.hpp"
+
+const auto kOverdrawFragShaderPath = "./assets/shaders/overdraw.frag.spv";
+
+// Below this many runs (or batches) per slice, recording in parallel costs
+// more than it saves.
+const size_t kMinDrawsPerSlice = 64;
+
+// Barrier moving a whole single-mip image from `oldLayout` to `newLayout`.
+static vk::ImageMemoryBarrier
+layoutTransition(vk::Image image, vk::ImageAspectFlags aspect,
+                 vk::ImageLayout oldLayout, vk::ImageLayout newLayout,
+                 vk::AccessFlags srcAccess, vk::AccessFlags dstAccess) {
+  return vk::ImageMemoryBarrier{}
+      .setImage(image)
+      .setSubresourceRange(vk::ImageSubresourceRange{aspect, 0, 1, 0, 1})
+      .setOldLayout(oldLayout)
+      .setNewLayout(newLayout)
+      .setSrcAccessMask(srcAccess)
+      .setDstAccessMask(dstAccess)
+      .setSrcQueueFamilyIndex(vk::QueueFamilyIgnored)
+      .setDstQueueFamilyIndex(vk::QueueFamilyIgnored);
 }
 
-vk::UniquePipeline createSimpleGraphicsPipeline(
-    vk::PipelineLayout layout,
-    std::span<vk::UniqueShaderModule, 2> shaderModules,
-    std::span<const vk::VertexInputBindingDescription> vertexBindings,
-    std::span<const vk::VertexInputAttributeDescription> vertexAttributes,
-    vk::RenderPass renderPass, vk::Device device) {
-  auto stages = std::to_array({
-      vk::PipelineShaderStageCreateInfo{
-          {}, vk::ShaderStageFlagBits::eVertex, *shaderModules[0], "main"},
-      vk::PipelineShaderStageCreateInfo{
-          {}, vk::ShaderStageFlagBits::eFragment, *shaderModules[1], "main"},
-  });
-  vk::PipelineVertexInputStateCreateInfo vertexInputInfo{
-      {}, vertexBindings, vertexAttributes};
-  vk::PipelineInputAssemblyStateCreateInfo inputAssemblyInfo{
-      {}, vk::PrimitiveTopology::eTriangleList};
-  auto dynamicStates = std::to_array({
-      vk::DynamicState::eViewport,
-      vk::DynamicState::eScissor,
-  });
-  auto dynamicStatesInfo =
-      vk::PipelineDynamicStateCreateInfo{}.setDynamicStates(dynamicStates);
-  auto rasterizationState =
-      vk::PipelineRasterizationStateCreateInfo{}.setLineWidth(1.0f);
-  auto viewportState =
-      vk::PipelineViewportStateCreateInfo{}.setViewportCount(1).setScissorCount(
-          1);
-  vk::PipelineMultisampleStateCreateInfo multisampleState{};
-  auto colorBlendingAttachments = std::to_array({
-      vk::PipelineColorBlendAttachmentState{}
-          .setBlendEnable(false)
-          .setColorWriteMask(
-              vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG |
-              vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA),
-  });
-  auto colorBlendState = vk::PipelineColorBlendStateCreateInfo{}.setAttachments(
-      colorBlendingAttachments);
-  auto pipeline = device
-                      .createGraphicsPipelineUnique(
-                          {}, vk::GraphicsPipelineCreateInfo{}
-                                  .setStages(stages)
-                                  .setPVertexInputState(&vertexInputInfo)
-                                  .setPInputAssemblyState(&inputAssemblyInfo)
-                                  .setPViewportState(&viewportState)
-                                  .setPRasterizationState(&rasterizationState)
-                                  .setPMultisampleState(&multisampleState)
-                                  .setPColorBlendState(&colorBlendState)
-                                  .setPDynamicState(&dynamicStatesInfo)
-                                  .setLayout(layout)
-                                  .setRenderPass(renderPass))
-                      .value;
-  return pipeline;
+// Size-dependent resources: the target's images and a depth buffer for each.
+static void createTargetResources(const GraphicsDevice &device,
+                                  const RenderTarget &target,
+                                  std::vector<vk::Image> &colorImages,
+                                  std::vector<vk::ImageView> &colorImageViews,
+                                  std::vector<Texture2D> &depthBuffers) {
+  colorImages.clear();
+  colorImageViews.clear();
+  for (ImageIndex i = 0; i < target.imageCount(); i++) {
+    colorImages.push_back(target.image(i));
+    colorImageViews.push_back(target.imageView(i));
+  }
+  depthBuffers =
+      std::views::iota(static_cast<size_t>(0), target.imageCount()) |
+      std::views::transform([&](auto) {
+        return Texture2D::create(
+            device, target.extent(), device.depthFormat(),
+            vk::ImageUsageFlagBits::eDepthStencilAttachment,
+            vma::MemoryUsage::eGpuOnly);
+      }) |
+      std::ranges::to<std::vector<Texture2D>>();
 }
 
 RenderSystem RenderSystem::create(const GraphicsDevice &device,
-                                  const Swapchain &swapchain,
+                                  const BindlessHeap &bindlessHeap,
+                                  const RenderTarget &target,
                                   std::optional<RenderSystem> old) {
   auto vkDevice = device.vkDevice();
 
   vk::UniqueCommandPool commandPool;
   std::vector<vk::CommandBuffer> commandBuffers;
+  std::unique_ptr<ThreadPool> threadPool;
+  SlicePools slicePools;
+  SliceCommandBuffers sliceCommandBuffers;
+  std::unique_ptr<FrameAllocator> frameAllocator;
   if (old.has_value()) {
     commandPool = std::move(old->_vkCommandPool);
     commandBuffers = std::move(old->_commandBuffers);
+    threadPool = std::move(old->_threadPool);
+    slicePools = std::move(old->_slicePools);
+    sliceCommandBuffers = std::move(old->_sliceCommandBuffers);
+    frameAllocator = std::move(old->_frameAllocator);
   } else {
     commandPool = device.createGraphicsCommandPool(
         vk::CommandPoolCreateFlagBits::eResetCommandBuffer);
     commandBuffers = vkDevice.allocateCommandBuffers(
         vk::CommandBufferAllocateInfo{}
-            .setCommandBufferCount(Swapchain::kMaxConcurrentFrames)
+            .setCommandBufferCount(
+                static_cast<uint32_t>(target.framesInFlight()))
             .setCommandPool(commandPool.get()));
+    threadPool =
+        std::make_unique<ThreadPool>(ThreadPool::defaultThreadCount());
+    // One pool per slice, so slices can be recorded from any thread. The
+    // calling thread records a slice as well.
+    for (size_t frame = 0; frame < target.framesInFlight(); frame++) {
+      for (size_t slice = 0; slice <= threadPool->threadCount(); slice++) {
+        slicePools[frame].push_back(device.createGraphicsCommandPool(
+            vk::CommandPoolCreateFlagBits::eTransient));
+        sliceCommandBuffers[frame].push_back(
+            vkDevice.allocateCommandBuffers(
+                vk::CommandBufferAllocateInfo{}
+                    .setCommandPool(slicePools[frame].back().get())
+                    .setLevel(vk::CommandBufferLevel::eSecondary)
+                    .setCommandBufferCount(1))[0]);
+      }
+    }
+    frameAllocator = std::make_unique<FrameAllocator>(device, bindlessHeap);
   }
 
-  auto renderPass = createRenderPass(device.vkDevice(), swapchain.format(),
-                                     device.depthFormat());
-  auto depthBuffers =
-      std::views::iota(static_cast<size_t>(0), swapchain.imageCount()) |
-      std::views::transform([&](auto) {
-        return Texture2D::create(
-            device, swapchain.extent(), device.depthFormat(),
-            vk::ImageUsageFlagBits::eDepthStencilAttachment,
-            vma::MemoryUsage::eGpuOnly);
-      }) |
-      std::ranges::to<std::vector<Texture2D>>();
-  auto framebuffers = std::views::zip_transform(
-                          [&](vk::ImageView color, const Texture2D &depth) {
-                            auto attachments = {color, depth.vkImageView()};
-                            return device.vkDevice().createFramebufferUnique(
-                                vk::FramebufferCreateInfo{}
-                                    .setRenderPass(*renderPass)
-                                    .setAttachments(attachments)
-                                    .setWidth(swapchain.extent().width)
-                                    .setHeight(swapchain.extent().height)
-                                    .setLayers(1));
-                          },
-                          swapchain.images(), depthBuffers) |
-                      std::ranges::to<std::vector>();
+  std::vector<vk::Image> colorImages;
+  std::vector<vk::ImageView> colorImageViews;
+  std::vector<Texture2D> depthBuffers;
+  createTargetResources(device, target, colorImages, colorImageViews,
+                        depthBuffers);
+  auto submissionMode =
+      old.has_value() ? old->_submissionMode : SubmissionMode::eIndirect;
+  auto cullingMode = old.has_value() ? old->_cullingMode : CullingMode::eGpu;
+  auto overdrawView = old.has_value() && old->_overdrawView;
+  auto gpuCulling = old.has_value() ? std::move(old->_gpuCulling)
+                                    : GpuCulling::create(device);
+  auto drawStatistics = old.has_value() ? std::move(old->_drawStatistics)
+                                        : DrawStatistics::create(device);
+  if (old.has_value()) {
+    // Frames in flight may still use its depth and per-frame buffers.
+    device.retire(std::move(*old));
+  }
   return {
-      device.graphicsQueue(), std::move(commandPool),  commandBuffers,
-      std::move(renderPass),  std::move(depthBuffers), std::move(framebuffers),
+      device,
+      bindlessHeap,
+      submissionMode,
+      cullingMode,
+      overdrawView,
+      std::move(gpuCulling),
+      std::move(drawStatistics),
+      std::move(commandPool),
+      commandBuffers,
+      std::move(threadPool),
+      std::move(slicePools),
+      std::move(sliceCommandBuffers),
+      std::move(frameAllocator),
+      target.format(),
+      device.depthFormat(),
+      target.finalLayout(),
+      std::move(colorImages),
+      std::move(colorImageViews),
+      std::move(depthBuffers),
+  };
+}
+
+bool RenderSystem::isCompatible(const RenderTarget &target) const {
+  return target.format() == _colorFormat &&
+         target.finalLayout() == _colorFinalLayout &&
+         _device->depthFormat() == _depthFormat;
+}
+
+void RenderSystem::resize(const RenderTarget &target) {
+  if (!isCompatible(target)) {
+    throw std::runtime_error("render target formats changed, the render "
+                             "system must be recreated");
+  }
+  _device->retire(std::move(_depthBuffers));
+  createTargetResources(*_device, target, _colorImages, _colorImageViews,
+                        _depthBuffers);
+}
+
+void RenderSystem::setSubmissionMode(SubmissionMode mode) {
+  bool supported = _device->features().drawIndirectFirstInstance;
+  _submissionMode = mode == SubmissionMode::eIndirect && !supported
+                        ? SubmissionMode::eDirect
+                        : mode;
+}
+
+void RenderSystem::buildRuns(DrawQueue &queue, bool instanceAll) {
+  _runs.clear();
+  _instances.clear();
+  auto packets = queue.sorted();
+  for (size_t i = 0; i < packets.size();) {
+    const auto &first = packets[i];
+    size_t end = i + 1;
+    while (end < packets.size() &&
+           packets[end].material->vkPipeline() ==
+               first.material->vkPipeline() &&
+           packets[end].mesh == first.mesh) {
+      end++;
+    }
+    auto instanceCount = static_cast<uint32_t>(end - i);
+    auto firstInstance = static_cast<uint32_t>(_instances.size());
+    if (instanceAll || instanceCount > 1) {
+      for (; i < end; i++) {
+        _instances.push_back(packets[i].instance);
+      }
+    }
+    _runs.push_back({&first, instanceCount, firstInstance});
+    i = end;
+  }
+}
+
+// Makes sure `target` holds at least `size` bytes, recreating its buffer with
+// (at least) twice the capacity when it doesn't. Returns a null handle when
+// `size` is zero.
+static vk::Buffer reserve(const GraphicsDevice &device, size_t size,
+                          vk::BufferUsageFlags usage,
+                          vma::MemoryUsage memoryUsage,
+                          RenderSystem::StreamingBuffer &target) {
+  if (size == 0) {
+    return nullptr;
+  }
+  if (target.capacity < size) {
+    target.capacity = std::max(size, target.capacity * 2);
+    target.buffer = Buffer::create(device, usage, memoryUsage, target.capacity);
+  }
+  return target.buffer->vkBuffer();
+}
+
+// Copies `data` into `target`, growing it as needed.
+template <class T>
+static vk::Buffer upload(const GraphicsDevice &device,
+                         const std::vector<T> &data, vk::BufferUsageFlags usage,
+                         RenderSystem::StreamingBuffer &target) {
+  auto buffer = reserve(device, data.size() * sizeof(T), usage,
+                        vma::MemoryUsage::eCpuToGpu, target);
+  if (buffer) {
+    target.buffer->copyRangeInto(device, data);
+  }
+  return buffer;
+}
+
+// Every run becomes an indirect command whose `firstInstance` points at its
+// transforms in the instance buffer. Runs sharing pipeline and buffers (e.g.
+// different meshes of a `MeshPool`) form a batch submitted with a single
+// `drawIndexedIndirect`. When culling on the GPU, commands start with no
+// instances and every instance becomes an object for the culling pass.
+void RenderSystem::buildBatches(bool gpuCulling) {
+  _indirectCommands.clear();
+  _batches.clear();
+  _cullObjects.clear();
+  for (const auto &run : _runs) {
+    const auto &packet = *run.packet;
+    const auto &mesh = packet.mesh;
+    if (_batches.empty() ||
+        _batches.back().packet->material->vkPipeline() !=
+            packet.material->vkPipeline() ||
+        _batches.back().packet->mesh.vertexBuffer != mesh.vertexBuffer ||
+        _batches.back().packet->mesh.indexBuffer != mesh.indexBuffer) {
+      _batches.push_back(
+          {&packet, static_cast<uint32_t>(_indirectCommands.size()), 0});
+    }
+    auto command = static_cast<uint32_t>(_indirectCommands.size());
+    _indirectCommands.push_back(vk::DrawIndexedIndirectCommand{
+        mesh.indexCount, gpuCulling ? 0 : run.instanceCount, mesh.firstIndex,
+        mesh.vertexOffset, run.firstInstance});
+    _batches.back().commandCount++;
+    if (gpuCulling) {
+      glm::vec4 sphere{packet.bounds.center, packet.bounds.radius};
+      for (uint32_t i = 0; i < run.instanceCount; i++) {
+        _cullObjects.push_back(
+            {_instances[run.firstInstance + i], sphere, command, {}});
+      }
+    }
+  }
+}
+
+// The overdraw variant of a pipeline only swaps its fragment shader and
+// blending, so it draws exactly the fragments the material would.
+void RenderSystem::requestOverdrawPipelines(const Material &material) {
+  auto pipeline = material.vkPipeline();
+  if (_overdrawPipelines.contains(pipeline)) {
+    return;
+  }
+  auto overdrawDesc = [](PipelineDesc desc) {
+    desc.fragmentShader = kOverdrawFragShaderPath;
+    desc.blend = BlendMode::eAdditive;
+    return desc;
   };
+  auto &registry = _device->pipelines();
+  const auto &pipelines = material.pipelines();
+  _overdrawPipelines.emplace(
+      pipeline,
+      MaterialPipelines{
+          registry.request(overdrawDesc(pipelines.plain.desc())),
+          registry.request(overdrawDesc(pipelines.instanced.desc()))});
+}
+
+const MaterialPipelines *
+RenderSystem::overdrawPipelines(const Material &material) const {
+  if (!_overdrawView) {
+    return nullptr;
+  }
+  return &_overdrawPipelines.at(material.vkPipeline());
+}
+
+void RenderSystem::recordDirect(const Frame &frame, vk::CommandBuffer cmd,
+                                std::span<const DrawRun> runs,
+                                GpuProfiler::BatchId profile,
+                                GpuProfiler::ScopeId parent) const {
+  auto &profiler = _device->gpuProfiler();
+  auto scope = GpuProfiler::kNoScope;
+  vk::Pipeline boundPipeline;
+  bool boundInstanced = false;
+  vk::Buffer boundVertexBuffer, boundIndexBuffer;
+  for (const auto &run : runs) {
+    const auto &packet = *run.packet;
+    const auto &mesh = packet.mesh;
+    bool instanced = run.instanceCount > 1;
+    const auto *overdraw = overdrawPipelines(*packet.material);
+    if (overdraw && !overdraw->vkPipeline()) {
+      continue;
+    }
+    if (packet.material->vkPipeline() != boundPipeline) {
+      profiler.end(profile, cmd, scope);
+      scope = profiler.begin(profile, cmd, packet.material->name(), parent);
+    }
+    if (packet.material->vkPipeline() != boundPipeline ||
+        instanced != boundInstanced) {
+      packet.material->bind(frame, cmd, instanced, *_frameAllocator);
+      if (overdraw) {
+        cmd.bindPipeline(vk::PipelineBindPoint::eGraphics,
+                         overdraw->vkPipeline(instanced));
+      }
+      boundPipeline = packet.material->vkPipeline();
+      boundInstanced = instanced;
+    }
+    if (mesh.vertexBuffer != boundVertexBuffer) {
+      cmd.bindVertexBuffers(0, mesh.vertexBuffer, {0});
+      boundVertexBuffer = mesh.vertexBuffer;
+    }
+    if (mesh.indexBuffer != boundIndexBuffer) {
+      cmd.bindIndexBuffer(mesh.indexBuffer, 0, vk::IndexType::eUint16);
+      boundIndexBuffer = mesh.indexBuffer;
+    }
+    // Runs are counted by their position in the whole frame's list.
+    auto draw = countedDraw(static_cast<size_t>(&run - _runs.data()));
+    _drawStatistics.begin(frame.index, cmd, draw);
+    if (instanced) {
+      cmd.drawIndexed(mesh.indexCount, run.instanceCount, mesh.firstIndex,
+                      mesh.vertexOffset, run.firstInstance);
+    } else {
+      packet.material->pushMeshUniforms(cmd, packet.instance);
+      cmd.drawIndexed(mesh.indexCount, 1, mesh.firstIndex, mesh.vertexOffset,
+                      0);
+    }
+    _drawStatistics.end(frame.index, cmd, draw);
+  }
+  profiler.end(profile, cmd, scope);
+}
+
+void RenderSystem::recordIndirect(const Frame &frame, vk::CommandBuffer cmd,
+                                  vk::Buffer indirectBuffer,
+                                  std::span<const DrawBatch> batches,
+                                  GpuProfiler::BatchId profile,
+                                  GpuProfiler::ScopeId parent) const {
+  const uint32_t stride = sizeof(vk::DrawIndexedIndirectCommand);
+  auto &profiler = _device->gpuProfiler();
+  auto scope = GpuProfiler::kNoScope;
+  vk::Pipeline scopePipeline;
+  for (const auto &batch : batches) {
+    const auto &mesh = batch.packet->mesh;
+    const auto *overdraw = overdrawPipelines(*batch.packet->material);
+    if (overdraw && !overdraw->vkPipeline()) {
+      continue;
+    }
+    // Consecutive batches of a pipeline only differ in their buffers.
+    if (batch.packet->material->vkPipeline() != scopePipeline) {
+      profiler.end(profile, cmd, scope);
+      scope = profiler.begin(profile, cmd, batch.packet->material->name(),
+                             parent);
+      scopePipeline = batch.packet->material->vkPipeline();
+    }
+    batch.packet->material->bind(frame, cmd, true, *_frameAllocator);
+    if (overdraw) {
+      cmd.bindPipeline(vk::PipelineBindPoint::eGraphics,
+                       overdraw->vkPipeline(true));
+    }
+    cmd.bindVertexBuffers(0, mesh.vertexBuffer, {0});
+    cmd.bindIndexBuffer(mesh.indexBuffer, 0, vk::IndexType::eUint16);
+    // Batches are counted by their position in the whole frame's list.
+    auto draw = countedDraw(static_cast<size_t>(&batch - _batches.data()));
+    _drawStatistics.begin(frame.index, cmd, draw);
+    if (_device->features().multiDrawIndirect) {
+      cmd.drawIndexedIndirect(indirectBuffer, batch.firstCommand * stride,
+                              batch.commandCount, stride);
+    } else {
+      for (uint32_t i = 0; i < batch.commandCount; i++) {
+        cmd.drawIndexedIndirect(indirectBuffer,
+                                (batch.firstCommand + i) * stride, 1, stride);
+      }
+    }
+    _drawStatistics.end(frame.index, cmd, draw);
+  }
+  profiler.end(profile, cmd, scope);
 }
 
-void RenderSystem::render(
-    Frame &frame, vk::Extent2D extent,
-    std::initializer_list<
-        std::tuple<Material &, const MeshUniforms &, const Model &>>
-        objects) {
-  auto clearValues = std::to_array<vk::ClearValue>(
-      {vk::ClearColorValue{std::array<float, 4>{0.0f, 0.0f, 0.0f, 1.0f}},
-       vk::ClearDepthStencilValue{1.0, 0}});
+void RenderSystem::render(Frame &frame, vk::Extent2D extent,
+                          DrawQueue &queue) {
+  CPU_ZONE("render");
+  _device->collectRetired();
+  // The target waited for the frame's previous use, so its uniforms are free.
+  _frameAllocator->beginFrame(frame.index);
+  auto &profiler = _device->gpuProfiler();
+  profiler.collect();
+  vk::ClearColorValue clearColor{std::array<float, 4>{0.0f, 0.0f, 0.0f, 1.0f}};
+  vk::ClearDepthStencilValue clearDepth{1.0, 0};
   vk::Viewport viewport{
       0.0f,
       0.0f,
@@ -176,33 +408,212 @@ void RenderSystem::render(
   };
   vk::Rect2D scissor{{0, 0}, extent};
 
+  bool indirect = _submissionMode == SubmissionMode::eIndirect;
+  bool gpuCulling = indirect && _cullingMode == CullingMode::eGpu;
+  {
+    CPU_ZONE("prepare draws");
+    if (_cullingMode != CullingMode::eNone && !gpuCulling) {
+      queue.cull();
+    }
+    queue.sort();
+    buildRuns(queue, indirect);
+    if (indirect) {
+      buildBatches(gpuCulling);
+    }
+    if (_overdrawView) {
+      for (const auto &run : _runs) {
+        requestOverdrawPipelines(*run.packet->material);
+      }
+    }
+  }
+
   auto cmd = _commandBuffers[frame.index];
-  auto framebuffer = _vkFramebuffers[frame.image].get();
   cmd.reset();
   cmd.begin(vk::CommandBufferBeginInfo{});
-  cmd.beginRenderPass(vk::RenderPassBeginInfo{}
-                          .setRenderPass(_vkRenderPass.get())
-                          .setFramebuffer(framebuffer)
-                          .setClearValues(clearValues)
-                          .setRenderArea(vk::Rect2D{{0, 0}, extent}),
-                      vk::SubpassContents::eInline);
-  cmd.setViewport(0, viewport);
-  cmd.setScissor(0, scissor);
-  for (auto [material, uniforms, model] : objects) {
-    material.render(frame, cmd, uniforms, model.vertexBuffer().vkBuffer(),
-                    model.indexBuffer().vkBuffer(), model.indexCount());
-  }
-  cmd.setViewport(0, viewport);
-  cmd.setScissor(0, scissor);
-  cmd.endRenderPass();
+  auto profile = profiler.beginBatch(cmd);
+  auto frameScope = profiler.begin(profile, cmd, "frame");
+  _drawNames.clear();
+  _drawIndices.clear();
+  if (_drawStatistics.enabled()) {
+    // Draws skipped while their overdraw variants compile get no query, as
+    // an unwritten one would hold back the whole frame's results. Variants
+    // only ever become ready, so no counted draw is skipped when recording.
+    auto count = [&](const DrawPacket &packet) {
+      const auto *overdraw = overdrawPipelines(*packet.material);
+      if (overdraw && !overdraw->vkPipeline()) {
+        _drawIndices.push_back(DrawStatistics::kNotCounted);
+        return;
+      }
+      _drawIndices.push_back(_drawNames.size());
+      _drawNames.push_back(packet.material->name());
+    };
+    if (indirect) {
+      for (const auto &batch : _batches) {
+        count(*batch.packet);
+      }
+    } else {
+      for (const auto &run : _runs) {
+        count(*run.packet);
+      }
+    }
+  }
+  _drawStatistics.beginFrame(
+      frame.index, cmd, _drawNames,
+      static_cast<uint64_t>(extent.width) * extent.height);
+
+  vk::Buffer instanceBuffer, indirectBuffer;
+  if (indirect) {
+    indirectBuffer = upload(*_device, _indirectCommands,
+                            vk::BufferUsageFlagBits::eIndirectBuffer |
+                                vk::BufferUsageFlagBits::eStorageBuffer,
+                            _indirectBuffers[frame.index]);
+  }
+  if (gpuCulling) {
+    auto objectBuffer =
+        upload(*_device, _cullObjects, vk::BufferUsageFlagBits::eStorageBuffer,
+               _cullObjectBuffers[frame.index]);
+    instanceBuffer = reserve(*_device, _instances.size() * sizeof(InstanceData),
+                             vk::BufferUsageFlagBits::eVertexBuffer |
+                                 vk::BufferUsageFlagBits::eStorageBuffer,
+                             vma::MemoryUsage::eGpuOnly,
+                             _culledInstanceBuffers[frame.index]);
+    if (objectBuffer) {
+      auto cullingScope = profiler.begin(profile, cmd, "culling", frameScope);
+      _gpuCulling.record(*_device, frame.index, cmd, objectBuffer,
+                         indirectBuffer, instanceBuffer,
+                         static_cast<uint32_t>(_cullObjects.size()));
+      profiler.end(profile, cmd, cullingScope);
+    }
+  } else {
+    instanceBuffer =
+        upload(*_device, _instances, vk::BufferUsageFlagBits::eVertexBuffer,
+               _instanceBuffers[frame.index]);
+  }
+
+  // Draws are split in slices recorded concurrently into secondary command
+  // buffers, unless there are too few of them to make it worthwhile.
+  size_t drawCount = indirect ? _batches.size() : _runs.size();
+  size_t sliceCount =
+      std::min(_sliceCommandBuffers[frame.index].size(),
+               (drawCount + kMinDrawsPerSlice - 1) / kMinDrawsPerSlice);
+  CPU_COUNTER("draws", drawCount);
+  CPU_COUNTER("slices", sliceCount);
+  bool parallel = sliceCount > 1;
+  auto colorImage = _colorImages[frame.image];
+  const auto &depthBuffer = _depthBuffers[frame.image];
+  auto depthAspect = getAspectForFormat(_depthFormat);
+  auto beginBarriers = std::to_array({
+      layoutTransition(colorImage, vk::ImageAspectFlagBits::eColor,
+                       vk::ImageLayout::eUndefined,
+                       vk::ImageLayout::eColorAttachmentOptimal, {},
+                       vk::AccessFlagBits::eColorAttachmentWrite),
+      layoutTransition(depthBuffer.vkImage(), depthAspect,
+                       vk::ImageLayout::eUndefined,
+                       vk::ImageLayout::eDepthStencilAttachmentOptimal,
+                       vk::AccessFlagBits::eDepthStencilAttachmentWrite,
+                       vk::AccessFlagBits::eDepthStencilAttachmentRead |
+                           vk::AccessFlagBits::eDepthStencilAttachmentWrite),
+  });
+  auto attachmentStages = vk::PipelineStageFlagBits::eColorAttachmentOutput |
+                          vk::PipelineStageFlagBits::eEarlyFragmentTests |
+                          vk::PipelineStageFlagBits::eLateFragmentTests;
+  auto mainPassScope = profiler.begin(profile, cmd, "main pass", frameScope);
+  cmd.pipelineBarrier(attachmentStages, attachmentStages, {}, {}, {},
+                      beginBarriers);
+
+  auto colorAttachment =
+      vk::RenderingAttachmentInfo{}
+          .setImageView(_colorImageViews[frame.image])
+          .setImageLayout(vk::ImageLayout::eColorAttachmentOptimal)
+          .setLoadOp(vk::AttachmentLoadOp::eClear)
+          .setStoreOp(vk::AttachmentStoreOp::eStore)
+          .setClearValue(clearColor);
+  auto depthAttachment =
+      vk::RenderingAttachmentInfo{}
+          .setImageView(depthBuffer.vkImageView())
+          .setImageLayout(vk::ImageLayout::eDepthStencilAttachmentOptimal)
+          .setLoadOp(vk::AttachmentLoadOp::eClear)
+          .setStoreOp(vk::AttachmentStoreOp::eDontCare)
+          .setClearValue(clearDepth);
+  vk::RenderingFlags renderingFlags;
+  if (parallel) {
+    renderingFlags = vk::RenderingFlagBits::eContentsSecondaryCommandBuffers;
+  }
+  cmd.beginRendering(
+      vk::RenderingInfo{}
+          .setFlags(renderingFlags)
+          .setRenderArea(vk::Rect2D{{0, 0}, extent})
+          .setLayerCount(1)
+          .setColorAttachments(colorAttachment)
+          .setPDepthAttachment(&depthAttachment));
+  auto recordSlice = [&](vk::CommandBuffer sliceCmd, size_t begin,
+                         size_t end) {
+    CPU_ZONE("record slice");
+    sliceCmd.setViewport(0, viewport);
+    sliceCmd.setScissor(0, scissor);
+    _bindlessHeap->bind(sliceCmd);
+    if (instanceBuffer) {
+      sliceCmd.bindVertexBuffers(kInstanceBinding, instanceBuffer, {0});
+    }
+    if (indirect) {
+      recordIndirect(frame, sliceCmd, indirectBuffer,
+                     std::span{_batches}.subspan(begin, end - begin), profile,
+                     mainPassScope);
+    } else {
+      recordDirect(frame, sliceCmd,
+                   std::span{_runs}.subspan(begin, end - begin), profile,
+                   mainPassScope);
+    }
+  };
+  if (parallel) {
+    auto renderingInheritance =
+        vk::CommandBufferInheritanceRenderingInfo{}
+            .setColorAttachmentFormats(_colorFormat)
+            .setDepthAttachmentFormat(_depthFormat)
+            .setRasterizationSamples(vk::SampleCountFlagBits::e1);
+    auto inheritanceInfo =
+        vk::CommandBufferInheritanceInfo{}.setPNext(&renderingInheritance);
+    auto vkDevice = _device->vkDevice();
+    auto &pools = _slicePools[frame.index];
+    auto &secondaries = _sliceCommandBuffers[frame.index];
+    _threadPool->parallelFor(sliceCount, [&](size_t slice) {
+      vkDevice.resetCommandPool(pools[slice].get());
+      secondaries[slice].begin(
+          vk::CommandBufferBeginInfo{}
+              .setFlags(vk::CommandBufferUsageFlagBits::eRenderPassContinue |
+                        vk::CommandBufferUsageFlagBits::eOneTimeSubmit)
+              .setPInheritanceInfo(&inheritanceInfo));
+      recordSlice(secondaries[slice], drawCount * slice / sliceCount,
+                  drawCount * (slice + 1) / sliceCount);
+      secondaries[slice].end();
+    });
+    cmd.executeCommands(std::span{secondaries}.first(sliceCount));
+  } else {
+    recordSlice(cmd, 0, drawCount);
+  }
+  cmd.endRendering();
+  profiler.end(profile, cmd, mainPassScope);
+  auto endBarrier = layoutTransition(
+      colorImage, vk::ImageAspectFlagBits::eColor,
+      vk::ImageLayout::eColorAttachmentOptimal, _colorFinalLayout,
+      vk::AccessFlagBits::eColorAttachmentWrite, {});
+  cmd.pipelineBarrier(vk::PipelineStageFlagBits::eColorAttachmentOutput,
+                      vk::PipelineStageFlagBits::eBottomOfPipe, {}, {}, {},
+                      endBarrier);
+  profiler.end(profile, cmd, frameScope);
   cmd.end();
 
   vk::PipelineStageFlags waitStage =
       vk::PipelineStageFlagBits::eColorAttachmentOutput;
-  auto submitInfo = vk::SubmitInfo{}
-                        .setWaitSemaphores(frame.readySemaphore)
-                        .setWaitDstStageMask(waitStage)
-                        .setCommandBuffers(cmd)
-                        .setSignalSemaphores(frame.doneSemaphore);
-  _graphicsQueue.submit(submitInfo, frame.fence);
+  auto submitInfo = vk::SubmitInfo{}.setCommandBuffers(cmd);
+  if (frame.readySemaphore) {
+    submitInfo.setWaitSemaphores(frame.readySemaphore)
+        .setWaitDstStageMask(waitStage);
+  }
+  if (frame.doneSemaphore) {
+    submitInfo.setSignalSemaphores(frame.doneSemaphore);
+  }
+  CPU_ZONE("submit");
+  frame.timelineValue = _device->submitGraphics(submitInfo);
+  profiler.submitted(profile, _device->graphicsTimeline(), frame.timelineValue);
 }
@@ -1,52 +1,233 @@
 #pragma once
 
+#include <array>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
 #include <vulkan/vulkan.hpp>
 
 #include <glm/glm.hpp>
 
+#include "bindless_heap.hpp"
+#include "buffer.hpp"
+#include "draw_statistics.hpp"
+#include "frame_allocator.hpp"
+#include "gpu_profiler.hpp"
+#include "gpu_culling.hpp"
+#include "material.hpp"
+#include "render_target.hpp"
 #include "textures.hpp"
+#include "thread_pool.hpp"
 
 struct GraphicsDevice;
-struct Swapchain;
-struct Material;
 struct Frame;
-struct MeshUniforms;
-struct Model;
+struct DrawPacket;
+struct DrawQueue;
+
+enum class SubmissionMode {
+  // One `drawIndexed` per run of identical draws.
+  eDirect,
+  // Draws are written to an indirect buffer and submitted with one
+  // `drawIndexedIndirect` per material and geometry buffers.
+  eIndirect,
+};
+
+enum class CullingMode {
+  eNone,
+  // Draws are culled on the CPU against the queue's frustum before sorting.
+  eCpu,
+  // Objects are culled by a compute pass before rendering. Falls back
+  // to `eCpu` with `SubmissionMode::eDirect`.
+  eGpu,
+};
+
 struct RenderSystem {
-  RenderSystem(vk::Queue graphicsQueue, vk::UniqueCommandPool vkCommandPool,
+  using SlicePools = std::array<std::vector<vk::UniqueCommandPool>,
+                                RenderTarget::kMaxConcurrentFrames>;
+  using SliceCommandBuffers = std::array<std::vector<vk::CommandBuffer>,
+                                         RenderTarget::kMaxConcurrentFrames>;
+
+  RenderSystem(const GraphicsDevice &device, const BindlessHeap &bindlessHeap,
+               SubmissionMode submissionMode, CullingMode cullingMode,
+               bool overdrawView, GpuCulling gpuCulling,
+               DrawStatistics drawStatistics,
+               vk::UniqueCommandPool vkCommandPool,
                std::vector<vk::CommandBuffer> commandBuffers,
-               vk::UniqueRenderPass vkRenderPass,
-               std::vector<Texture2D> depthBuffers,
-               std::vector<vk::UniqueFramebuffer> vkFramebuffers)
-      : _graphicsQueue(graphicsQueue), _vkCommandPool(std::move(vkCommandPool)),
+               std::unique_ptr<ThreadPool> threadPool, SlicePools slicePools,
+               SliceCommandBuffers sliceCommandBuffers,
+               std::unique_ptr<FrameAllocator> frameAllocator,
+               vk::Format colorFormat, vk::Format depthFormat,
+               vk::ImageLayout colorFinalLayout,
+               std::vector<vk::Image> colorImages,
+               std::vector<vk::ImageView> colorImageViews,
+               std::vector<Texture2D> depthBuffers)
+      : _device(&device), _bindlessHeap(&bindlessHeap),
+        _cullingMode(cullingMode), _overdrawView(overdrawView),
+        _gpuCulling(std::move(gpuCulling)),
+        _drawStatistics(std::move(drawStatistics)),
+        _vkCommandPool(std::move(vkCommandPool)),
         _commandBuffers(std::move(commandBuffers)),
-        _vkRenderPass(std::move(vkRenderPass)),
-        _depthBuffers(std::move(depthBuffers)),
-        _vkFramebuffers(std::move(vkFramebuffers)) {}
+        _threadPool(std::move(threadPool)),
+        _slicePools(std::move(slicePools)),
+        _sliceCommandBuffers(std::move(sliceCommandBuffers)),
+        _frameAllocator(std::move(frameAllocator)),
+        _colorFormat(colorFormat), _depthFormat(depthFormat),
+        _colorFinalLayout(colorFinalLayout),
+        _colorImages(std::move(colorImages)),
+        _colorImageViews(std::move(colorImageViews)),
+        _depthBuffers(std::move(depthBuffers)) {
+    setSubmissionMode(submissionMode);
+  }
 
+  // `bindlessHeap` must outlive the system, and be the one materials drawn
+  // through it were created with. What isn't carried over from `old` is
+  // retired rather than destroyed.
   static RenderSystem create(const GraphicsDevice &device,
-                             const Swapchain &swapchain,
+                             const BindlessHeap &bindlessHeap,
+                             const RenderTarget &target,
                              std::optional<RenderSystem> old = std::nullopt);
 
-  inline vk::RenderPass vkRenderPass() const { return _vkRenderPass.get(); }
+  // Whether `target` has the formats the system (and so every pipeline drawing
+  // through it) was created for.
+  bool isCompatible(const RenderTarget &target) const;
+  // Recreates only the size-dependent resources for a compatible `target`,
+  // e.g. a resized swapchain. Materials and pipelines stay valid. The previous
+  // resources are retired, so frames in flight can still use them.
+  void resize(const RenderTarget &target);
+
+  // Attachment formats of pipelines drawing through this system. Points into
+  // the system, so it must not be moved while the result is in use.
+  inline vk::PipelineRenderingCreateInfo pipelineRenderingInfo() const {
+    return vk::PipelineRenderingCreateInfo{}
+        .setColorAttachmentFormats(_colorFormat)
+        .setDepthAttachmentFormat(_depthFormat);
+  }
+  inline const BindlessHeap &bindlessHeap() const { return *_bindlessHeap; }
+  inline SubmissionMode submissionMode() const { return _submissionMode; }
+  // Falls back to `eDirect` when the device can't offset instances from
+  // indirect commands.
+  void setSubmissionMode(SubmissionMode mode);
+  inline CullingMode cullingMode() const { return _cullingMode; }
+  inline void setCullingMode(CullingMode mode) { _cullingMode = mode; }
+  // Shades every fragment of every draw with an additive constant instead of
+  // its material, keeping depth state, so the image shows how many fragments
+  // were shaded at each pixel. Draws are skipped until the overdraw variants
+  // of their pipelines are compiled.
+  inline bool overdrawView() const { return _overdrawView; }
+  inline void setOverdrawView(bool enabled) { _overdrawView = enabled; }
+  // Pipeline statistics of the draws, once enabled on it.
+  inline DrawStatistics &drawStatistics() { return _drawStatistics; }
+
+  // Sorts `queue` and records its draws. The bindless heap is bound once,
+  // pipelines and buffers are only rebound when they differ from the previous
+  // draw, and consecutive draws of the same model with the same pipeline are
+  // merged into a single instanced draw, whatever their material. In
+  // `eIndirect` mode draws sharing pipeline and geometry buffers are further
+  // merged into a single indirect draw.
+  // Large draw lists are recorded in parallel into secondary command buffers.
+  // The frame, its culling and main passes, and the draws of each pipeline
+  // are timed by the device's `GpuProfiler`. Each draw call is counted by the
+  // `DrawStatistics` under its material's name.
+  void render(Frame &frame, vk::Extent2D viewport, DrawQueue &queue);
 
-  void render(Frame &frame, vk::Extent2D viewport,
-              std::initializer_list<
-                  std::tuple<Material &, const MeshUniforms &, const Model &>>
-                  objects);
+  // Buffer rewritten every frame and grown on demand.
+  struct StreamingBuffer {
+    std::optional<Buffer> buffer;
+    // In bytes
+    size_t capacity = 0;
+  };
 
 private:
-  vk::Queue _graphicsQueue;
+  // Consecutive packets drawn with a single `drawIndexed`.
+  struct DrawRun {
+    const DrawPacket *packet;
+    uint32_t instanceCount;
+    uint32_t firstInstance;
+  };
+  // Consecutive indirect commands drawn with a single `drawIndexedIndirect`.
+  struct DrawBatch {
+    const DrawPacket *packet;
+    uint32_t firstCommand;
+    uint32_t commandCount;
+  };
 
-  // Swapchain-shared resources
+  // When `instanceAll` is set every run reads its transforms from the
+  // instance buffer, otherwise only runs of more than one draw do.
+  void buildRuns(DrawQueue &queue, bool instanceAll);
+  void buildBatches(bool gpuCulling);
+  // Requests the overdraw variants of `material`'s pipelines, unless already
+  // requested.
+  void requestOverdrawPipelines(const Material &material);
+  // Null unless in the overdraw view.
+  const MaterialPipelines *overdrawPipelines(const Material &material) const;
+  // Index in `_drawNames` of the run or batch at `position`, if counted.
+  inline size_t countedDraw(size_t position) const {
+    return position < _drawIndices.size() ? _drawIndices[position]
+                                          : DrawStatistics::kNotCounted;
+  }
+  // Draws of each pipeline are profiled as children of `parent`.
+  void recordDirect(const Frame &frame, vk::CommandBuffer cmd,
+                    std::span<const DrawRun> runs,
+                    GpuProfiler::BatchId profile,
+                    GpuProfiler::ScopeId parent) const;
+  void recordIndirect(const Frame &frame, vk::CommandBuffer cmd,
+                      vk::Buffer indirectBuffer,
+                      std::span<const DrawBatch> batches,
+                      GpuProfiler::BatchId profile,
+                      GpuProfiler::ScopeId parent) const;
+
+  const GraphicsDevice *_device;
+  const BindlessHeap *_bindlessHeap;
+  SubmissionMode _submissionMode = SubmissionMode::eDirect;
+  CullingMode _cullingMode;
+  bool _overdrawView;
+  GpuCulling _gpuCulling;
+  DrawStatistics _drawStatistics;
+  // Overdraw variants, by pipeline of the material they replace
+  std::unordered_map<vk::Pipeline, MaterialPipelines> _overdrawPipelines;
+
+  // Target-shared resources
   vk::UniqueCommandPool _vkCommandPool;
   std::vector<vk::CommandBuffer> _commandBuffers;
+  std::unique_ptr<ThreadPool> _threadPool;
+  // Secondary command buffers, one per slice of the draw list
+  SlicePools _slicePools;
+  SliceCommandBuffers _sliceCommandBuffers;
+  // Per-frame uniforms of materials
+  std::unique_ptr<FrameAllocator> _frameAllocator;
 
-  // Swapchain-related resources
+  // Target-related resources
   const Material *_material = nullptr;
-  vk::UniqueRenderPass _vkRenderPass;
+  vk::Format _colorFormat;
+  vk::Format _depthFormat;
+  vk::ImageLayout _colorFinalLayout;
 
-  // Swapchain-exclusive resources
+  // Target-exclusive resources. Color images are owned by the target.
+  std::vector<vk::Image> _colorImages;
+  std::vector<vk::ImageView> _colorImageViews;
   std::vector<Texture2D> _depthBuffers;
-  std::vector<vk::UniqueFramebuffer> _vkFramebuffers;
+
+  // Per-frame resources, grown on demand
+  std::array<StreamingBuffer, RenderTarget::kMaxConcurrentFrames>
+      _instanceBuffers;
+  std::array<StreamingBuffer, RenderTarget::kMaxConcurrentFrames>
+      _indirectBuffers;
+  std::array<StreamingBuffer, RenderTarget::kMaxConcurrentFrames>
+      _cullObjectBuffers;
+  // Instances surviving GPU culling, written by the culling pass
+  std::array<StreamingBuffer, RenderTarget::kMaxConcurrentFrames>
+      _culledInstanceBuffers;
+  std::vector<DrawRun> _runs;
+  std::vector<InstanceData> _instances;
+  std::vector<DrawBatch> _batches;
+  std::vector<vk::DrawIndexedIndirectCommand> _indirectCommands;
+  std::vector<CullObject> _cullObjects;
+  // Names of the draws counted by `_drawStatistics`, in recording order, and
+  // the index in it of every run or batch
+  std::vector<std::string_view> _drawNames;
+  std::vector<size_t> _drawIndices;
 };
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <chrono>
+#include <format>
+#include <optional>
+#include <stdexcept>
+
+#include <vulkan/vulkan.hpp>
+
+using FrameIndex = uint32_t;
+using ImageIndex = uint32_t;
+
+struct Frame {
+  FrameIndex index;
+  ImageIndex image;
+  vk::Semaphore readySemaphore;
+  vk::Semaphore doneSemaphore;
+  // Graphics timeline value signalled once the frame is rendered. Set by
+  // `RenderSystem::render`.
+  uint64_t timelineValue;
+  // When the input the frame reacts to was sampled, if the caller tracks it.
+  // Targets that present measure latency from there.
+  std::chrono::steady_clock::time_point inputTime;
+};
+
+// Something `RenderSystem` can draw into: either a presentable swapchain or an
+// offscreen set of images. Semaphores in the returned `Frame` may be null when
+// the target has nothing to synchronize with (e.g. no presentation engine).
+// Targets pace frames on the device's graphics timeline: a frame index, and
+// so the per-frame resources of the renderer, is only handed out again once
+// the GPU has reached the value of its previous frame.
+struct RenderTarget {
+  // Frames the CPU may record ahead of the GPU are chosen per target, within
+  // [1, kMaxConcurrentFrames]. Fewer means less latency, more means the CPU
+  // and the GPU overlap more. Per-frame arrays are sized for the maximum.
+  const static size_t kMaxConcurrentFrames = 4;
+  const static size_t kDefaultConcurrentFrames = 2;
+
+  virtual ~RenderTarget() {}
+
+  // Throws unless `count` is a supported number of frames in flight.
+  static void checkFramesInFlight(size_t count);
+
+  virtual std::optional<Frame> nextImage() = 0;
+  virtual void present(Frame frame) = 0;
+
+  // Frame indices handed out are below this.
+  virtual size_t framesInFlight() const = 0;
+  virtual vk::Extent2D extent() const = 0;
+  virtual vk::Format format() const = 0;
+  virtual size_t imageCount() const = 0;
+  virtual vk::Image image(ImageIndex image) const = 0;
+  virtual vk::ImageView imageView(ImageIndex image) const = 0;
+  // Layout images must be left in once rendering is done.
+  virtual vk::ImageLayout finalLayout() const = 0;
+  virtual bool needsRecreation() const = 0;
+};
+
+inline void RenderTarget::checkFramesInFlight(size_t count) {
+  if (count < 1 || count > kMaxConcurrentFrames) {
+    throw std::runtime_error(
+        std::format("unsupported number of frames in flight {} (1 to {})",
+                    count, kMaxConcurrentFrames));
+  }
+}
@@ -0,0 +1,14 @@
+// Descriptor set shared by every material. Must match `BindlessHeap` on the
+// C++ side.
+
+// Must match `MaterialParameters` on the C++ side.
+struct MaterialParameters {
+  float4 color;
+  uint4 textures;
+};
+
+[[vk::binding(0, 0)]] StructuredBuffer<MaterialParameters> material_parameters;
+[[vk::binding(1, 0)]] SamplerState texture_sampler;
+// Indices that may differ within a draw (e.g. coming from the instance data)
+// must go through `NonUniformResourceIndex`.
+[[vk::binding(2, 0)]] Texture2D textures[4096];
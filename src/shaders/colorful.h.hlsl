@@ -1,18 +1,22 @@
 static const float PI = 3.14159265f;
 
+// Must match `InstanceData` on the C++ side.
 struct PerMeshUniforms {
   float4x4 mvp;
+  uint material;
 };
 
+// Must match `ColorfulMaterial::PerFrameUniforms` on the C++ side.
 struct PerFrameUniforms {
   float time;
 };
 
 [[vk::push_constant]]
-cbuffer push_constants {
-  PerMeshUniforms per_mesh_uniforms;
-  PerFrameUniforms per_frame_uniforms;
-};
+cbuffer push_constants { PerMeshUniforms per_mesh_uniforms; };
+
+// Dynamic uniform buffer of the `FrameAllocator`, set
+// `BindlessHeap::kFrameUniformSet`.
+[[vk::binding(0, 1)]] ConstantBuffer<PerFrameUniforms> per_frame_uniforms;
 
 struct VSOutput {
   float4 position : SV_Position;
@@ -0,0 +1,12 @@
+#include "colorful.h.hlsl"
+#include "instancing.h.hlsl"
+
+struct VSInput {
+  [[vk::location(0)]] float3 position : POSITION0;
+};
+
+VSOutput main(const VSInput input, const InstanceInput instance) {
+  VSOutput output;
+  output.position = instance_transform(instance, float4(input.position, 1.0));
+  return output;
+}
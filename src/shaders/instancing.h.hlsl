@@ -0,0 +1,14 @@
+// Per-instance MVP matrix of instanced draws, one column per attribute, and
+// material index. Must match `kInstanceAttributes` on the C++ side.
+struct InstanceInput {
+  [[vk::location(1)]] float4 mvp_0 : INSTANCE_MVP0;
+  [[vk::location(2)]] float4 mvp_1 : INSTANCE_MVP1;
+  [[vk::location(3)]] float4 mvp_2 : INSTANCE_MVP2;
+  [[vk::location(4)]] float4 mvp_3 : INSTANCE_MVP3;
+  [[vk::location(5)]] uint material : INSTANCE_MATERIAL;
+};
+
+float4 instance_transform(InstanceInput instance, float4 position) {
+  return instance.mvp_0 * position.x + instance.mvp_1 * position.y +
+         instance.mvp_2 * position.z + instance.mvp_3 * position.w;
+}
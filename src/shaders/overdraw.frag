@@ -0,0 +1,13 @@
+// Replaces the fragment shader of every material in the overdraw view. Blended
+// additively, so each fragment shaded at a pixel brightens it: one layer is
+// dark red, four saturate red, eight reach yellow and sixteen white.
+
+struct FSOutput {
+  float4 color : SV_Target0;
+};
+
+FSOutput main() {
+  FSOutput output;
+  output.color = float4(0.25, 0.125, 0.0625, 1.0);
+  return output;
+}
@@ -6,6 +6,6 @@ struct FSOutput {
 
 FSOutput main(VSOutput input) {
   FSOutput output;
-  output.color = float4(per_mesh_uniforms.color, 1.0);
+  output.color = material_parameters[input.material].color;
   return output;
 }
@@ -1,11 +1,15 @@
+#include "bindless.h.hlsl"
+
+// Must match `InstanceData` on the C++ side.
 struct PerMeshUniforms {
-  float3 color;
+  float4x4 mvp;
+  uint material;
 };
 
-cbuffer per_mesh_uniforms : register(b0, space0) {
-  PerMeshUniforms per_mesh_uniforms;
-}
+[[vk::push_constant]]
+cbuffer push_constants { PerMeshUniforms per_mesh_uniforms; };
 
 struct VSOutput {
   float4 position : SV_Position;
+  nointerpolation uint material : MATERIAL;
 };
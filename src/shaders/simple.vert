@@ -6,6 +6,7 @@ struct VSInput {
 
 VSOutput main(const VSInput input) {
   VSOutput output;
-  output.position = float4(input.position, 1.0);
+  output.position = mul(per_mesh_uniforms.mvp, float4(input.position, 1.0));
+  output.material = per_mesh_uniforms.material;
   return output;
 }
@@ -0,0 +1,13 @@
+#include "simple.h.hlsl"
+#include "instancing.h.hlsl"
+
+struct VSInput {
+  [[vk::location(0)]] float3 position : POSITION0;
+};
+
+VSOutput main(const VSInput input, const InstanceInput instance) {
+  VSOutput output;
+  output.position = instance_transform(instance, float4(input.position, 1.0));
+  output.material = instance.material;
+  return output;
+}
@@ -1,7 +1,9 @@
 static const float PI = 3.14159265f;
 
+// Must match `InstanceData` on the C++ side.
 struct PerMeshUniforms {
   float4x4 mvp;
+  uint material;
 };
 
 [[vk::push_constant]]
@@ -0,0 +1,14 @@
+#include "vaporwave_skybox.h.hlsl"
+#include "instancing.h.hlsl"
+
+struct VSInput {
+  [[vk::location(0)]] float3 position : POSITION0;
+};
+
+VSOutput main(const VSInput input, const InstanceInput instance) {
+  VSOutput output;
+  output.position_model = float4(input.position, 1.0);
+  output.position_clip =
+      instance_transform(instance, float4(input.position, 1.0));
+  return output;
+}
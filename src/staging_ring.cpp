@@ -0,0 +1,83 @@
+#include "staging_ring.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "deletion_queue.hpp"
+#include "timeline.hpp"
+
+StagingRing::StagingRing(vma::Allocator allocator, const Timeline &uploads,
+                         DeletionQueue &retiredUploads)
+    : _allocator(allocator), _uploads(&uploads),
+      _retiredUploads(&retiredUploads),
+      _buffer(Buffer::createMapped(allocator,
+                                   vk::BufferUsageFlagBits::eTransferSrc,
+                                   kCapacity)) {}
+
+StagingRing::Allocation StagingRing::allocate(vk::DeviceSize size) {
+  auto alignedSize = alignUp(size);
+  if (alignedSize > kCapacity) {
+    auto buffer = Buffer::createMapped(
+        _allocator, vk::BufferUsageFlagBits::eTransferSrc, size);
+    Allocation allocation{buffer.vkBuffer(), 0, buffer.mappedData()};
+    _dedicated.push_back(std::move(buffer));
+    return allocation;
+  }
+
+  auto head = headFor(alignedSize);
+  reclaim(head, alignedSize);
+  if (_tail == _head) {
+    // Nothing is in use, so the skipped space is free too.
+    _tail = head;
+  }
+  if (head + alignedSize - _tail > kCapacity) {
+    throw std::runtime_error("staging ring is out of space");
+  }
+  _head = head + alignedSize;
+  auto offset = head % kCapacity;
+  return {_buffer.vkBuffer(), offset, _buffer.mappedData() + offset};
+}
+
+bool StagingRing::fits(vk::DeviceSize size) const {
+  auto alignedSize = alignUp(size);
+  // Once every submitted upload is reclaimed, only what wasn't submitted is
+  // in use, if anything.
+  auto tail = std::max(_tail, _submittedHead);
+  return alignedSize > kCapacity || _head == tail ||
+         headFor(alignedSize) + alignedSize - tail <= kCapacity;
+}
+
+void StagingRing::submitted(uint64_t value) {
+  if (_head != _submittedHead) {
+    _pending.push_back({value, _head});
+    _submittedHead = _head;
+  }
+  for (auto &buffer : _dedicated) {
+    _retiredUploads->retire(value, std::move(buffer));
+  }
+  _dedicated.clear();
+}
+
+vk::DeviceSize StagingRing::headFor(vk::DeviceSize size) const {
+  // Allocations never straddle the end of the buffer: the space left before
+  // it is skipped instead.
+  if (_head % kCapacity + size > kCapacity) {
+    return _head + kCapacity - _head % kCapacity;
+  }
+  return _head;
+}
+
+void StagingRing::reclaim(vk::DeviceSize head, vk::DeviceSize size) {
+  auto completed = _uploads->completedValue();
+  while (!_pending.empty()) {
+    const auto &oldest = _pending.front();
+    if (oldest.value > completed) {
+      if (head + size - _tail <= kCapacity) {
+        break;
+      }
+      _uploads->wait(oldest.value);
+    }
+    _tail = oldest.end;
+    _pending.pop_front();
+  }
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include <vk_mem_alloc.hpp>
+#include <vulkan/vulkan.hpp>
+
+#include "buffer.hpp"
+
+struct DeletionQueue;
+struct Timeline;
+// Staging memory for host-to-device copies. A single persistently mapped
+// buffer is used as a ring: uploads write their data at the head, which wraps
+// around to the start when the end of the buffer is reached, and the space is
+// reclaimed once the upload timeline reaches the upload that read it. Staging
+// an upload costs a copy into mapped memory, with no allocation or mapping.
+// When the ring is full, staging waits for the oldest upload still using it.
+//
+// Uploads larger than the ring are staged in a buffer of their own, retired
+// after the upload.
+//
+// Not thread-safe, like uploads themselves.
+struct StagingRing {
+  // Bytes of the ring
+  static constexpr vk::DeviceSize kCapacity = 32 * 1024 * 1024;
+  // Enough for copies to buffers, and to images with texels of power-of-two
+  // sizes
+  static constexpr vk::DeviceSize kAlignment = 16;
+
+  struct Allocation {
+    vk::Buffer buffer;
+    // Offset in `buffer`, e.g. the source offset of a copy
+    vk::DeviceSize offset;
+    std::byte *data;
+  };
+
+  // Space is reclaimed as `uploads` advances. Dedicated staging buffers are
+  // retired to `retiredUploads`.
+  StagingRing(vma::Allocator allocator, const Timeline &uploads,
+              DeletionQueue &retiredUploads);
+  StagingRing(const StagingRing &) = delete;
+  StagingRing &operator=(const StagingRing &) = delete;
+
+  // Allocations are aligned to `kAlignment`. The data must be written before
+  // the upload reading it is submitted. Throws when allocations not yet
+  // `submitted` fill the ring.
+  Allocation allocate(vk::DeviceSize size);
+  // Whether `allocate(size)` can succeed before what was allocated so far is
+  // `submitted`. It may still wait for earlier uploads.
+  bool fits(vk::DeviceSize size) const;
+  // Marks everything allocated since the previous call as read by the upload
+  // signalling `value` on the upload timeline.
+  void submitted(uint64_t value);
+
+private:
+  inline static vk::DeviceSize alignUp(vk::DeviceSize size) {
+    return (size + kAlignment - 1) / kAlignment * kAlignment;
+  }
+  // Where an allocation of `size` aligned bytes would start
+  vk::DeviceSize headFor(vk::DeviceSize size) const;
+
+  // Allocated space up to `end`, read by the upload signalling `value`
+  struct Pending {
+    uint64_t value;
+    vk::DeviceSize end;
+  };
+
+  // Reclaims the space of the uploads the GPU is done with, then of the
+  // oldest ones until `size` bytes fit at `head`, waiting for them if need be.
+  void reclaim(vk::DeviceSize head, vk::DeviceSize size);
+
+  vma::Allocator _allocator;
+  const Timeline *_uploads;
+  DeletionQueue *_retiredUploads;
+  Buffer _buffer;
+  // Positions grow monotonically; the offset in the buffer is their
+  // remainder by `kCapacity`. Bytes in [_tail, _head) are in use.
+  vk::DeviceSize _head = 0;
+  vk::DeviceSize _tail = 0;
+  // Head when `submitted` was last called
+  vk::DeviceSize _submittedHead = 0;
+  std::deque<Pending> _pending;
+  // Dedicated buffers allocated since `submitted` was last called
+  std::vector<Buffer> _dedicated;
+};
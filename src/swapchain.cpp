@@ -1,13 +1,54 @@
 #include "swapchain.hpp"
 
+#include <algorithm>
 #include <limits>
+#include <ranges>
 #include <vulkan/vulkan.hpp>
 
+#include "cpu_profiler.hpp"
 #include "graphics_device.hpp"
+#include "timeline.hpp"
 #include "window.hpp"
 
+// Bounds how long low latency mode waits for a frame to be displayed, in
+// nanoseconds, as a hidden window may never display anything.
+const uint64_t kLowLatencyTimeout = 100'000'000;
+
+static vk::PresentModeKHR
+selectPresentMode(PresentPolicy policy,
+                  std::span<const vk::PresentModeKHR> supported) {
+  auto isSupported = [&](vk::PresentModeKHR mode) {
+    return std::ranges::contains(supported, mode);
+  };
+  switch (policy) {
+  case PresentPolicy::eImmediate:
+    if (isSupported(vk::PresentModeKHR::eImmediate)) {
+      return vk::PresentModeKHR::eImmediate;
+    }
+    [[fallthrough]];
+  case PresentPolicy::eMailbox:
+    if (isSupported(vk::PresentModeKHR::eMailbox)) {
+      return vk::PresentModeKHR::eMailbox;
+    }
+    break;
+  case PresentPolicy::eRelaxedVsync:
+    if (isSupported(vk::PresentModeKHR::eFifoRelaxed)) {
+      return vk::PresentModeKHR::eFifoRelaxed;
+    }
+    break;
+  case PresentPolicy::eVsync:
+    break;
+  }
+  return vk::PresentModeKHR::eFifo;
+}
+
 Swapchain Swapchain::create(const Window &window, const GraphicsDevice &device,
+                            SwapchainSettings settings,
                             std::optional<Swapchain> oldSwapchain) {
+  if (oldSwapchain.has_value()) {
+    settings = oldSwapchain->_settings;
+  }
+  checkFramesInFlight(settings.framesInFlight);
   auto vkPhysicalDevice = device.vkPhysicalDevice();
   auto vkDevice = device.vkDevice();
   auto vkSurface = device.vkSurface();
@@ -18,8 +59,12 @@ Swapchain Swapchain::create(const Window &window, const GraphicsDevice &device,
   auto formats = vkPhysicalDevice.getSurfaceFormatsKHR(vkSurface);
   auto presentModes = vkPhysicalDevice.getSurfacePresentModesKHR(vkSurface);
 
-  auto minImageCount =
-      std::max(capabilities.minImageCount + 1, capabilities.maxImageCount);
+  // One more than the minimum, so acquiring never waits for the presentation
+  // engine to release an image. A maximum of 0 means there is none.
+  auto minImageCount = capabilities.minImageCount + 1;
+  if (capabilities.maxImageCount > 0) {
+    minImageCount = std::min(minImageCount, capabilities.maxImageCount);
+  }
   auto format = std::ranges::find_if(formats, [](vk::SurfaceFormatKHR format) {
     return format.format == vk::Format::eB8G8R8A8Srgb &&
            format.colorSpace == vk::ColorSpaceKHR::eSrgbNonlinear;
@@ -27,10 +72,7 @@ Swapchain Swapchain::create(const Window &window, const GraphicsDevice &device,
   if (format == formats.end()) {
     format = formats.begin();
   }
-  auto presentMode =
-      std::ranges::contains(presentModes, vk::PresentModeKHR::eMailbox)
-          ? vk::PresentModeKHR::eMailbox
-          : vk::PresentModeKHR::eFifo;
+  auto presentMode = selectPresentMode(settings.presentPolicy, presentModes);
 
   auto windowSize = window.size();
   vk::Extent2D extent{std::clamp((uint32_t)windowSize.width,
@@ -78,55 +120,86 @@ Swapchain Swapchain::create(const Window &window, const GraphicsDevice &device,
                                 }));
                       }) |
                       std::ranges::to<std::vector<vk::UniqueImageView>>();
-  std::array<vk::UniqueFence, kMaxConcurrentFrames> frameFences;
-  std::array<vk::UniqueSemaphore, kMaxConcurrentFrames> readyImageSemaphores;
-  std::array<vk::UniqueSemaphore, kMaxConcurrentFrames> doneImageSemaphores;
-  std::ranges::generate(frameFences, [&device]() {
-    return device.vkDevice().createFenceUnique(
-        vk::FenceCreateInfo{}.setFlags(vk::FenceCreateFlagBits::eSignaled));
-  });
-  std::ranges::generate(readyImageSemaphores, [&device]() {
-    return device.vkDevice().createSemaphoreUnique({});
-  });
-  std::ranges::generate(doneImageSemaphores, [&device]() {
-    return device.vkDevice().createSemaphoreUnique({});
-  });
-  std::vector<vk::Fence> imageFences;
-  imageFences.resize(vkImages.size());
+  std::array<vk::UniqueSemaphore, kMaxConcurrentFrames> readySemaphores;
+  FrameValues frameValues{};
+  FrameIndex frame = 0;
+  uint64_t presentId = 0;
+  std::vector<Latency> latencies;
+  size_t nextLatency = 0;
+  if (oldSwapchain.has_value()) {
+    frameValues = oldSwapchain->_frameValues;
+    frame = oldSwapchain->_frame;
+    presentId = oldSwapchain->_presentId;
+    // Presents still pending on the old swapchain are not measured.
+    latencies = std::move(oldSwapchain->_latencies);
+    nextLatency = oldSwapchain->_nextLatency;
+    // Semaphores are not carried over: one whose present failed may still be
+    // signalled.
+    device.retire(std::move(*oldSwapchain));
+  }
+  std::generate_n(
+      readySemaphores.begin(), settings.framesInFlight,
+      [&device]() { return device.vkDevice().createSemaphoreUnique({}); });
+  auto doneSemaphores =
+      vkImages | std::ranges::views::transform([&](vk::Image) {
+        return vkDevice.createSemaphoreUnique({});
+      }) |
+      std::ranges::to<std::vector<vk::UniqueSemaphore>>();
+  std::vector<uint64_t> imageValues(vkImages.size(), 0);
+  // Not part of the static dispatcher, since the extension is optional.
+  auto waitForPresent =
+      device.presentWait()
+          ? reinterpret_cast<PFN_vkWaitForPresentKHR>(
+                vkDevice.getProcAddr("vkWaitForPresentKHR"))
+          : nullptr;
   return {vkDevice,
           device.presentQueue(),
+          device.graphicsTimeline(),
           std::move(vkSwapchain),
           extent,
           *format,
           vkImages,
           std::move(vkImageViews),
-          std::move(readyImageSemaphores),
-          std::move(doneImageSemaphores),
-          std::move(frameFences),
-          std::move(imageFences)};
+          std::move(readySemaphores),
+          std::move(doneSemaphores),
+          settings,
+          presentMode,
+          waitForPresent,
+          frameValues,
+          std::move(imageValues),
+          frame,
+          presentId,
+          std::move(latencies),
+          nextLatency};
 }
 
 std::optional<Frame> Swapchain::nextImage() {
-  auto readySemaphore = _readySemaphores[_frame].get();
-  auto doneSemaphore = _doneSemaphores[_frame].get();
-  auto frameFence = _frameFences[_frame].get();
-  _frame = (_frame + 1) % kMaxConcurrentFrames;
-  std::ignore = _owner.waitForFences(frameFence, true,
-                                     std::numeric_limits<uint64_t>::max());
+  CPU_ZONE("next image");
+  auto index = _frame;
+  auto readySemaphore = _readySemaphores[index].get();
+  if (_waitForPresent) {
+    // In low latency mode, the previous frame is displayed before the next
+    // one samples its input.
+    collectPresented(_settings.lowLatency ? kLowLatencyTimeout : 0);
+  }
+  // The ready semaphore, like the renderer's resources for this index, is
+  // free once the previous frame of the same index is rendered.
+  _timeline->wait(_frameValues[index]);
   try {
     auto result = _owner.acquireNextImageKHR(
         _vkSwapchain.get(), std::numeric_limits<uint64_t>::max(),
         readySemaphore);
     auto image = result.value;
-    auto &imageFence = _imageFences[image];
-    if (imageFence != nullptr) {
-      std::ignore = _owner.waitForFences(imageFence, true,
-                                         std::numeric_limits<uint64_t>::max());
-    }
-    imageFence = frameFence;
-    _owner.resetFences(frameFence);
-    _needsRecreation = result.result == vk::Result::eSuccess;
-    return {{_frame, image, readySemaphore, doneSemaphore, frameFence}};
+    // Images may come back out of order, while the frame of another index
+    // that last drew into them (and into their depth buffer) still runs.
+    _timeline->wait(_imageValues[image]);
+    _frame = static_cast<FrameIndex>((_frame + 1) % _settings.framesInFlight);
+    // Only recreation clears the flag, which a suboptimal present may
+    // already have set.
+    _needsRecreation =
+        _needsRecreation || result.result == vk::Result::eSuboptimalKHR;
+    return {{index, image, readySemaphore, _doneSemaphores[image].get(), 0,
+             {}}};
   } catch (vk::OutOfDateKHRError &) {
     _needsRecreation = true;
     return std::nullopt;
@@ -134,14 +207,68 @@ std::optional<Frame> Swapchain::nextImage() {
 }
 
 void Swapchain::present(Frame frame) {
+  _frameValues[frame.index] = frame.timelineValue;
+  _imageValues[frame.image] = frame.timelineValue;
+  auto presentId = ++_presentId;
+  auto presentIdInfo = vk::PresentIdKHR{}.setPresentIds(presentId);
   auto presentInfo = vk::PresentInfoKHR{}
+                         .setPNext(_waitForPresent ? &presentIdInfo : nullptr)
                          .setWaitSemaphores(frame.doneSemaphore)
                          .setSwapchains(_vkSwapchain.get())
                          .setImageIndices(frame.image);
   try {
     auto result = _presentQueue.presentKHR(presentInfo);
-    _needsRecreation = result != vk::Result::eSuccess;
+    // A suboptimal acquire stays flagged even if presenting succeeds.
+    _needsRecreation = _needsRecreation || result != vk::Result::eSuccess;
   } catch (vk::OutOfDateKHRError &) {
     _needsRecreation = true;
+    return;
+  }
+  if (frame.inputTime == std::chrono::steady_clock::time_point{}) {
+    return;
+  }
+  if (_waitForPresent) {
+    _pendingPresents.push_back({presentId, frame.inputTime});
+  } else {
+    recordLatency(frame.inputTime);
+  }
+}
+
+// Displays are only noticed here, so outside of low latency mode, latencies
+// are rounded up to the next call.
+void Swapchain::collectPresented(uint64_t timeout) {
+  auto wait = [&](uint64_t presentId, uint64_t waitTimeout) {
+    return static_cast<vk::Result>(
+        _waitForPresent(_owner, _vkSwapchain.get(), presentId, waitTimeout));
+  };
+  if (timeout > 0 && !_pendingPresents.empty()) {
+    wait(_pendingPresents.back().presentId, timeout);
+  }
+  while (!_pendingPresents.empty()) {
+    auto pending = _pendingPresents.front();
+    auto result = wait(pending.presentId, 0);
+    if (result == vk::Result::eTimeout) {
+      return;
+    }
+    if (result != vk::Result::eSuccess &&
+        result != vk::Result::eSuboptimalKHR) {
+      // Out of date, or lost: these presents will never be measured.
+      _needsRecreation = _needsRecreation ||
+                         result == vk::Result::eErrorOutOfDateKHR;
+      _pendingPresents.clear();
+      return;
+    }
+    recordLatency(pending.inputTime);
+    _pendingPresents.pop_front();
+  }
+}
+
+void Swapchain::recordLatency(std::chrono::steady_clock::time_point inputTime) {
+  Latency latency = std::chrono::steady_clock::now() - inputTime;
+  if (_latencies.size() < kLatencyWindow) {
+    _latencies.push_back(latency);
+  } else {
+    _latencies[_nextLatency] = latency;
+    _nextLatency = (_nextLatency + 1) % kLatencyWindow;
   }
 }
@@ -1,72 +1,155 @@
 #pragma once
 
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
 #include <optional>
-#include <ranges>
+#include <span>
+#include <vector>
 
 #include <vulkan/vulkan.hpp>
 #include <vulkan/vulkan_handles.hpp>
 
-using FrameIndex = uint32_t;
-using ImageIndex = uint32_t;
-
-struct Frame {
-  FrameIndex index;
-  ImageIndex image;
-  vk::Semaphore readySemaphore;
-  vk::Semaphore doneSemaphore;
-  vk::Fence fence;
-};
+#include "render_target.hpp"
 
 struct GraphicsDevice;
+struct Timeline;
 struct Window;
-struct Swapchain {
-  const static size_t kMaxConcurrentFrames = 2;
+
+// How presented images reach the display, from most to least latency. When
+// the surface lacks the requested mode, `eImmediate` falls back to
+// `eMailbox`, and everything else to `eVsync`, which every surface supports.
+enum class PresentPolicy {
+  // Every image is shown on a vertical blank, in order (FIFO).
+  eVsync,
+  // Like `eVsync`, but an image presented late is shown right away, tearing
+  // (FIFO relaxed).
+  eRelaxedVsync,
+  // The newest image replaces any waiting one and is shown on the next
+  // vertical blank (mailbox).
+  eMailbox,
+  // Images are shown as soon as they are presented, tearing (immediate).
+  eImmediate,
+};
+
+struct SwapchainSettings {
+  size_t framesInFlight = RenderTarget::kDefaultConcurrentFrames;
+  PresentPolicy presentPolicy = PresentPolicy::eMailbox;
+  // Waits for the previous frame to be displayed before handing out the next
+  // one, so input is sampled as late as possible. Needs present wait
+  // (`GraphicsDevice::presentWait`), ignored without it.
+  bool lowLatency = false;
+};
+
+// Acquire and present still synchronize through binary semaphores, as the
+// presentation engine requires: one per frame index for acquiring, and one
+// per image for presenting, since an image is only acquired again once its
+// presentation is done. Everything else is paced on the graphics timeline.
+//
+// Every presented frame records its latency: from `Frame::inputTime` to the
+// image reaching the display with present wait, or to the present call
+// without it.
+struct Swapchain : public RenderTarget {
+  using FrameValues = std::array<uint64_t, kMaxConcurrentFrames>;
+  using Latency = std::chrono::duration<float, std::milli>;
+  // Latencies kept, the most recent ones.
+  static constexpr size_t kLatencyWindow = 10000;
 
   Swapchain(
-      vk::Device owner, vk::Queue presentQueue,
+      vk::Device owner, vk::Queue presentQueue, Timeline &timeline,
       vk::UniqueSwapchainKHR vkSwapchain, vk::Extent2D extent,
       vk::SurfaceFormatKHR format, std::vector<vk::Image> vkImages,
       std::vector<vk::UniqueImageView> vkImageViews,
       std::array<vk::UniqueSemaphore, kMaxConcurrentFrames> readySemaphores,
-      std::array<vk::UniqueSemaphore, kMaxConcurrentFrames> doneSemaphores,
-      std::array<vk::UniqueFence, kMaxConcurrentFrames> frameFences,
-      std::vector<vk::Fence> imageFences)
-      : _owner(owner), _presentQueue(presentQueue),
+      std::vector<vk::UniqueSemaphore> doneSemaphores,
+      SwapchainSettings settings, vk::PresentModeKHR presentMode,
+      PFN_vkWaitForPresentKHR waitForPresent, FrameValues frameValues,
+      std::vector<uint64_t> imageValues, FrameIndex frame,
+      uint64_t presentId, std::vector<Latency> latencies, size_t nextLatency)
+      : _owner(owner), _presentQueue(presentQueue), _timeline(&timeline),
         _vkSwapchain(std::move(vkSwapchain)), _extent(extent), _format(format),
         _vkImages(std::move(vkImages)), _vkImageViews(std::move(vkImageViews)),
         _readySemaphores(std::move(readySemaphores)),
         _doneSemaphores(std::move(doneSemaphores)),
-        _frameFences(std::move(frameFences)), _imageFences(imageFences) {}
+        _settings(settings), _presentMode(presentMode),
+        _waitForPresent(waitForPresent), _frameValues(frameValues),
+        _imageValues(std::move(imageValues)), _frame(frame),
+        _presentId(presentId), _latencies(std::move(latencies)),
+        _nextLatency(nextLatency) {}
 
+  // Frame pacing carries over from `oldSwapchain`, so frames still in flight
+  // are waited for as usual, and the rest of it is retired: there is no need
+  // to wait for the device to be idle first. `settings` are ignored when
+  // there is an `oldSwapchain`, which keeps its own, as well as the
+  // latencies recorded so far.
   static Swapchain create(const Window &window, const GraphicsDevice &device,
+                          SwapchainSettings settings = {},
                           std::optional<Swapchain> oldSwapchain = std::nullopt);
 
   std::optional<Frame> nextImage();
   void present(Frame frame);
 
+  inline size_t framesInFlight() const { return _settings.framesInFlight; }
+  inline const SwapchainSettings &settings() const { return _settings; }
+  // Mode picked for `settings().presentPolicy`.
+  inline vk::PresentModeKHR presentMode() const { return _presentMode; }
+  // Whether latencies run up to the display rather than the present call.
+  inline bool measuresDisplayLatency() const { return _waitForPresent; }
+  // One per frame presented, over the last `kLatencyWindow` frames at most,
+  // in no particular order.
+  inline std::span<const Latency> latencies() const { return _latencies; }
   inline vk::Extent2D extent() const { return _extent; };
   inline vk::Format format() const { return _format.format; };
   inline vk::ColorSpaceKHR colorSpace() const { return _format.colorSpace; };
   inline size_t imageCount() const { return _vkImages.size(); }
-  inline auto images() const {
-    return _vkImageViews |
-           std::ranges::views::transform(
-               [](const vk::UniqueImageView &s) { return s.get(); });
+  inline vk::Image image(ImageIndex image) const { return _vkImages[image]; }
+  inline vk::ImageView imageView(ImageIndex image) const {
+    return _vkImageViews[image].get();
+  }
+  inline vk::ImageLayout finalLayout() const {
+    return vk::ImageLayout::ePresentSrcKHR;
   }
   inline bool needsRecreation() const { return _needsRecreation; }
 
 private:
+  struct PendingPresent {
+    uint64_t presentId;
+    std::chrono::steady_clock::time_point inputTime;
+  };
+
+  // Records the latency of the frames displayed so far, waiting up to
+  // `timeout` nanoseconds for the oldest one.
+  void collectPresented(uint64_t timeout);
+  // Records the latency of a frame whose input was sampled at `inputTime`.
+  void recordLatency(std::chrono::steady_clock::time_point inputTime);
+
   vk::Device _owner;
   vk::Queue _presentQueue;
+  Timeline *_timeline;
   vk::UniqueSwapchainKHR _vkSwapchain;
   vk::Extent2D _extent;
   vk::SurfaceFormatKHR _format;
   std::vector<vk::Image> _vkImages;
   std::vector<vk::UniqueImageView> _vkImageViews;
   std::array<vk::UniqueSemaphore, kMaxConcurrentFrames> _readySemaphores;
-  std::array<vk::UniqueSemaphore, kMaxConcurrentFrames> _doneSemaphores;
-  std::array<vk::UniqueFence, kMaxConcurrentFrames> _frameFences;
-  std::vector<vk::Fence> _imageFences;
+  std::vector<vk::UniqueSemaphore> _doneSemaphores;
+  SwapchainSettings _settings;
+  vk::PresentModeKHR _presentMode;
+  // Null without present wait.
+  PFN_vkWaitForPresentKHR _waitForPresent;
+  // Graphics timeline values of the last frame of each index, and of the last
+  // frame rendered into each image
+  FrameValues _frameValues;
+  std::vector<uint64_t> _imageValues;
   bool _needsRecreation = false;
-  FrameIndex _frame = 0;
+  FrameIndex _frame;
+  // Id of the last present; ids keep growing across recreations.
+  uint64_t _presentId;
+  // Presents not displayed yet, oldest first
+  std::deque<PendingPresent> _pendingPresents;
+  // Ring of latencies, overwritten from `_nextLatency` once full.
+  std::vector<Latency> _latencies;
+  size_t _nextLatency;
 };
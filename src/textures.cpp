@@ -1,5 +1,6 @@
 #include "textures.hpp"
 
+#include <cstring>
 #include <stdexcept>
 #include <string>
 #include <vulkan/vulkan_enums.hpp>
@@ -9,10 +10,9 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
-#include "buffer.hpp"
-#include "buffer_impl.hpp"
+#include "cpu_profiler.hpp"
 #include "graphics_device.hpp"
-#include "graphics_device_impl.hpp"
+#include "upload_queue.hpp"
 
 vk::ImageAspectFlags getAspectForFormat(vk::Format format) {
   switch (format) {
@@ -21,6 +21,11 @@ vk::ImageAspectFlags getAspectForFormat(vk::Format format) {
   case vk::Format::eD32SfloatS8Uint:
   case vk::Format::eD24UnormS8Uint:
     return vk::ImageAspectFlagBits::eDepth | vk::ImageAspectFlagBits::eStencil;
+  case vk::Format::eR8G8B8A8Unorm:
+  case vk::Format::eR8G8B8A8Srgb:
+  case vk::Format::eB8G8R8A8Unorm:
+  case vk::Format::eB8G8R8A8Srgb:
+    return vk::ImageAspectFlagBits::eColor;
   default:
     throw std::runtime_error("TBI");
   }
@@ -58,16 +63,15 @@ Texture2D Texture2D::loadFromFile(const GraphicsDevice &device,
                                   std::string_view filepath,
                                   vk::ImageUsageFlags usage,
                                   vk::ImageLayout layout) {
+  CPU_ZONE("load texture");
   std::string filepathOwned(filepath);
   const int channels = 4;
   int width, height;
   auto imageData =
       stbi_load(filepathOwned.c_str(), &width, &height, nullptr, channels);
   size_t size = static_cast<size_t>(width * height * channels);
-  auto stagingBuffer =
-      Buffer::create(device, vk::BufferUsageFlagBits::eTransferSrc,
-                     vma::MemoryUsage::eCpuToGpu, size);
-  stagingBuffer.copyRangeInto(device, std::span{imageData, size});
+  auto staging = device.uploads().stage(size);
+  std::memcpy(staging.data, imageData, size);
   stbi_image_free(imageData);
 
   vk::Extent2D dimensions{static_cast<uint32_t>(width),
@@ -75,49 +79,42 @@ Texture2D Texture2D::loadFromFile(const GraphicsDevice &device,
   auto texture =
       Texture2D::create(device, dimensions, vk::Format::eR8G8B8A8Srgb, usage,
                         vma::MemoryUsage::eGpuOnly);
-  texture.copyFrom(device, stagingBuffer, dimensions,
+  texture.copyFrom(device, staging.buffer, staging.offset, dimensions,
                    vk::ImageLayout::eUndefined, layout);
 
   return texture;
 }
 
-void Texture2D::copyFrom(const GraphicsDevice &device, const Buffer &buffer,
-                         vk::Extent2D dimensions, vk::ImageLayout srcLayout,
-                         vk::ImageLayout dstLayout) const {
-  device.runOneTimeWork([&](vk::CommandBuffer cmd) {
+UploadToken Texture2D::copyFrom(const GraphicsDevice &device,
+                               vk::Buffer buffer, vk::DeviceSize bufferOffset,
+                               vk::Extent2D dimensions,
+                               vk::ImageLayout srcLayout,
+                               vk::ImageLayout dstLayout) {
+  auto &uploads = device.uploads();
+  auto range = vk::ImageSubresourceRange{}
+                   .setAspectMask(vk::ImageAspectFlagBits::eColor)
+                   .setLayerCount(1)
+                   .setLevelCount(1);
+  _uploadToken = uploads.record([&](vk::CommandBuffer cmd) {
     cmd.pipelineBarrier(
         vk::PipelineStageFlagBits::eTopOfPipe,
         vk::PipelineStageFlagBits::eTransfer, {}, {}, {},
         vk::ImageMemoryBarrier{}
             .setImage(vkImage())
-            .setSubresourceRange(
-                vk::ImageSubresourceRange{}
-                    .setAspectMask(vk::ImageAspectFlagBits::eColor)
-                    .setLayerCount(1)
-                    .setLevelCount(1))
+            .setSubresourceRange(range)
             .setOldLayout(srcLayout)
             .setNewLayout(vk::ImageLayout::eTransferDstOptimal)
             .setDstAccessMask(vk::AccessFlagBits::eTransferWrite));
     cmd.copyBufferToImage(
-        buffer.vkBuffer(), vkImage(), vk::ImageLayout::eTransferDstOptimal,
+        buffer, vkImage(), vk::ImageLayout::eTransferDstOptimal,
         vk::BufferImageCopy{}
+            .setBufferOffset(bufferOffset)
             .setImageExtent({dimensions.width, dimensions.height, 1})
             .setBufferRowLength(dimensions.width)
             .setImageSubresource(
                 vk::ImageSubresourceLayers{}.setLayerCount(1).setAspectMask(
                     vk::ImageAspectFlagBits::eColor)));
-    cmd.pipelineBarrier(
-        vk::PipelineStageFlagBits::eTransfer,
-        vk::PipelineStageFlagBits::eFragmentShader, {}, {}, {},
-        vk::ImageMemoryBarrier{}
-            .setImage(vkImage())
-            .setSubresourceRange(
-                vk::ImageSubresourceRange{}
-                    .setAspectMask(vk::ImageAspectFlagBits::eColor)
-                    .setLayerCount(1)
-                    .setLevelCount(1))
-            .setOldLayout(vk::ImageLayout::eTransferDstOptimal)
-            .setNewLayout(dstLayout)
-            .setDstAccessMask(vk::AccessFlagBits::eTransferWrite));
+    uploads.releaseImage(cmd, vkImage(), range, dstLayout);
   });
+  return _uploadToken;
 }
@@ -4,8 +4,11 @@
 
 #include <vk_mem_alloc.hpp>
 
+#include "upload_token.hpp"
+
+vk::ImageAspectFlags getAspectForFormat(vk::Format format);
+
 struct GraphicsDevice;
-struct Buffer;
 struct Texture2D {
   Texture2D(vma::UniqueImage vkImage, vma::UniqueAllocation vmaAllocation,
             vk::UniqueImageView vkImageView)
@@ -15,20 +18,30 @@ struct Texture2D {
   static Texture2D create(const GraphicsDevice &device, vk::Extent2D dimensions,
                           vk::Format format, vk::ImageUsageFlags usage,
                           vma::MemoryUsage memoryUsage);
+  // Uploaded through the device's upload batch, see `uploadToken`.
   static Texture2D loadFromFile(const GraphicsDevice &device,
                                 std::string_view filepath,
                                 vk::ImageUsageFlags usage,
                                 vk::ImageLayout layout);
 
-  void copyFrom(const GraphicsDevice &device, const Buffer &buffer,
-                vk::Extent2D dimensions, vk::ImageLayout srcLayout,
-                vk::ImageLayout dstLayout) const;
+  // Records a copy of tightly packed texels at `bufferOffset` in `buffer`,
+  // e.g. a staging ring allocation, into the device's upload batch. The
+  // image is then handed over to graphics work in `dstLayout`. Uploads may
+  // run on a queue of their own, which doesn't own the image's previous
+  // contents, so `srcLayout` should be `eUndefined`.
+  UploadToken copyFrom(const GraphicsDevice &device, vk::Buffer buffer,
+                       vk::DeviceSize bufferOffset, vk::Extent2D dimensions,
+                       vk::ImageLayout srcLayout, vk::ImageLayout dstLayout);
 
   inline vk::Image vkImage() const { return _vkImage.get(); }
   inline vk::ImageView vkImageView() const { return _vkImageView.get(); }
+  // Token of the uploads into this texture so far, done once its texels are
+  // on the GPU.
+  inline UploadToken uploadToken() const { return _uploadToken; }
 
 private:
   vma::UniqueImage _vkImage;
   vma::UniqueAllocation _vmaAllocation;
   vk::UniqueImageView _vkImageView;
+  UploadToken _uploadToken;
 };
@@ -0,0 +1,51 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+
+#include "cpu_profiler.hpp"
+
+ThreadPool::ThreadPool(size_t threadCount) {
+  _threads.reserve(threadCount);
+  for (size_t i = 0; i < threadCount; i++) {
+    _threads.emplace_back(
+        [this](std::stop_token stopToken) { work(stopToken); });
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  for (auto &thread : _threads) {
+    thread.request_stop();
+  }
+}
+
+size_t ThreadPool::defaultThreadCount() {
+  auto hardwareThreads =
+      static_cast<size_t>(std::thread::hardware_concurrency());
+  return std::max<size_t>(hardwareThreads, 2) - 1;
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+  {
+    std::scoped_lock lock{_mutex};
+    _tasks.push_back(std::move(task));
+  }
+  _taskAvailable.notify_one();
+}
+
+void ThreadPool::work(std::stop_token stopToken) {
+  CPU_THREAD_NAME("pool worker");
+  while (true) {
+    std::function<void()> task;
+    {
+      std::unique_lock lock{_mutex};
+      if (!_taskAvailable.wait(lock, stopToken,
+                               [this] { return !_tasks.empty(); })) {
+        return;
+      }
+      task = std::move(_tasks.front());
+      _tasks.pop_front();
+    }
+    CPU_ZONE("task");
+    task();
+  }
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <concepts>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads consuming a shared task queue. Tasks still
+// queued when the pool is destroyed are dropped.
+struct ThreadPool {
+  explicit ThreadPool(size_t threadCount);
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+  ~ThreadPool();
+
+  // One worker per hardware thread, minus the calling one.
+  static size_t defaultThreadCount();
+
+  inline size_t threadCount() const { return _threads.size(); }
+
+  void submit(std::function<void()> task);
+  // Runs `fn(i)` for every `i` in [0, count), the calling thread taking part,
+  // and returns once all calls are done. The first exception thrown by `fn`
+  // is rethrown.
+  template <std::invocable<size_t> TFn>
+  void parallelFor(size_t count, const TFn &fn);
+
+private:
+  void work(std::stop_token stopToken);
+
+  std::mutex _mutex;
+  std::condition_variable_any _taskAvailable;
+  std::deque<std::function<void()>> _tasks;
+  // Last, so workers are stopped before the queue goes away.
+  std::vector<std::jthread> _threads;
+};
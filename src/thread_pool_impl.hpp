@@ -0,0 +1,35 @@
+#pragma once
+
+#include "thread_pool.hpp"
+
+#include <exception>
+#include <latch>
+
+template <std::invocable<size_t> TFn>
+void ThreadPool::parallelFor(size_t count, const TFn &fn) {
+  if (count == 0) {
+    return;
+  }
+  std::latch done{static_cast<std::ptrdiff_t>(count)};
+  std::mutex errorMutex;
+  std::exception_ptr error;
+  auto run = [&](size_t i) {
+    try {
+      fn(i);
+    } catch (...) {
+      std::scoped_lock lock{errorMutex};
+      if (!error) {
+        error = std::current_exception();
+      }
+    }
+    done.count_down();
+  };
+  for (size_t i = 1; i < count; i++) {
+    submit([&run, i] { run(i); });
+  }
+  run(0);
+  done.wait();
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
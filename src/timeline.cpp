@@ -0,0 +1,69 @@
+#include "timeline.hpp"
+
+#include <limits>
+#include <vector>
+
+Timeline::Timeline(vk::Device device) : _device(device) {
+  auto typeInfo = vk::SemaphoreTypeCreateInfo{}
+                      .setSemaphoreType(vk::SemaphoreType::eTimeline)
+                      .setInitialValue(0);
+  _vkSemaphore = device.createSemaphoreUnique(
+      vk::SemaphoreCreateInfo{}.setPNext(&typeInfo));
+}
+
+uint64_t Timeline::submit(vk::Queue queue, vk::SubmitInfo submitInfo,
+                          std::span<const TimelineWait> waits) {
+  // Values of binary semaphores already in `submitInfo` are ignored.
+  std::vector<vk::Semaphore> waitSemaphores(
+      submitInfo.pWaitSemaphores,
+      submitInfo.pWaitSemaphores + submitInfo.waitSemaphoreCount);
+  std::vector<vk::PipelineStageFlags> waitStages(
+      submitInfo.pWaitDstStageMask,
+      submitInfo.pWaitDstStageMask + submitInfo.waitSemaphoreCount);
+  std::vector<uint64_t> waitValues(waitSemaphores.size(), 0);
+  for (const auto &wait : waits) {
+    waitSemaphores.push_back(wait.semaphore);
+    waitStages.push_back(wait.stages);
+    waitValues.push_back(wait.value);
+  }
+  std::vector<vk::Semaphore> signalSemaphores(
+      submitInfo.pSignalSemaphores,
+      submitInfo.pSignalSemaphores + submitInfo.signalSemaphoreCount);
+  signalSemaphores.push_back(_vkSemaphore.get());
+  std::vector<uint64_t> signalValues(signalSemaphores.size(), 0);
+
+  // Values must be signalled in increasing order, so they are handed out and
+  // submitted under the same lock.
+  std::scoped_lock lock{_mutex};
+  auto value = _submittedValue + 1;
+  signalValues.back() = value;
+  auto timelineInfo = vk::TimelineSemaphoreSubmitInfo{}
+                          .setWaitSemaphoreValues(waitValues)
+                          .setSignalSemaphoreValues(signalValues);
+  submitInfo.setPNext(&timelineInfo)
+      .setWaitSemaphores(waitSemaphores)
+      .setWaitDstStageMask(waitStages)
+      .setSignalSemaphores(signalSemaphores);
+  queue.submit(submitInfo);
+  _submittedValue = value;
+  return value;
+}
+
+uint64_t Timeline::submittedValue() const {
+  std::scoped_lock lock{_mutex};
+  return _submittedValue;
+}
+
+uint64_t Timeline::completedValue() const {
+  return _device.getSemaphoreCounterValue(_vkSemaphore.get());
+}
+
+void Timeline::wait(uint64_t value) const {
+  if (reached(value)) {
+    return;
+  }
+  auto semaphore = _vkSemaphore.get();
+  std::ignore = _device.waitSemaphores(
+      vk::SemaphoreWaitInfo{}.setSemaphores(semaphore).setValues(value),
+      std::numeric_limits<uint64_t>::max());
+}
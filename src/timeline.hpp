@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <span>
+
+#include <vulkan/vulkan.hpp>
+
+// Point some work waits for on another timeline, e.g. graphics waiting for
+// uploads.
+struct TimelineWait {
+  vk::Semaphore semaphore;
+  uint64_t value;
+  vk::PipelineStageFlags stages;
+};
+
+// Timeline semaphore counting submissions. Every submission made through it
+// signals the next value, so work is identified by the value it signals, and
+// reaching a value means every submission up to it has completed.
+struct Timeline {
+  explicit Timeline(vk::Device device);
+  Timeline(const Timeline &) = delete;
+  Timeline &operator=(const Timeline &) = delete;
+
+  inline vk::Semaphore vkSemaphore() const { return _vkSemaphore.get(); }
+
+  // Submits `submitInfo` to `queue`, additionally waiting for `waits` and
+  // signalling the next value. Returns that value.
+  uint64_t submit(vk::Queue queue, vk::SubmitInfo submitInfo,
+                  std::span<const TimelineWait> waits = {});
+  // Value signalled by the latest submission.
+  uint64_t submittedValue() const;
+  // Value reached by the GPU.
+  uint64_t completedValue() const;
+  inline bool reached(uint64_t value) const {
+    return completedValue() >= value;
+  }
+  // Blocks until the GPU reaches `value`. Returns right away if it has.
+  void wait(uint64_t value) const;
+
+private:
+  vk::Device _device;
+  vk::UniqueSemaphore _vkSemaphore;
+  mutable std::mutex _mutex;
+  uint64_t _submittedValue = 0;
+};
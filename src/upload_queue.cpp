@@ -0,0 +1,167 @@
+#include "upload_queue.hpp"
+
+#include "cpu_profiler.hpp"
+#include "deletion_queue.hpp"
+#include "timeline.hpp"
+
+UploadQueue::UploadQueue(vk::Device device, vk::Queue queue,
+                         uint32_t queueFamily, vk::CommandPool commandPool,
+                         uint32_t graphicsFamily,
+                         vk::CommandPool acquireCommandPool,
+                         vma::Allocator allocator, Timeline &timeline,
+                         const Timeline &graphicsTimeline,
+                         DeletionQueue &retiredUploads,
+                         GpuProfiler *gpuProfiler)
+    : _device(device), _queue(queue), _queueFamily(queueFamily),
+      _commandPool(commandPool), _graphicsFamily(graphicsFamily),
+      _acquireCommandPool(acquireCommandPool), _timeline(&timeline),
+      _graphicsTimeline(&graphicsTimeline), _retiredUploads(&retiredUploads),
+      _gpuProfiler(gpuProfiler),
+      _stagingRing(allocator, timeline, retiredUploads) {}
+
+StagingRing::Allocation UploadQueue::stage(vk::DeviceSize size) {
+  if (_batch && !_stagingRing.fits(size)) {
+    flush();
+  }
+  return _stagingRing.allocate(size);
+}
+
+void UploadQueue::waitForFrames() {
+  if (_batch) {
+    _batch->waitForFrames = dedicated();
+  }
+}
+
+void UploadQueue::releaseImage(vk::CommandBuffer cmd, vk::Image image,
+                               vk::ImageSubresourceRange range,
+                               vk::ImageLayout newLayout) {
+  auto barrier = vk::ImageMemoryBarrier{}
+                     .setImage(image)
+                     .setSubresourceRange(range)
+                     .setOldLayout(vk::ImageLayout::eTransferDstOptimal)
+                     .setNewLayout(newLayout)
+                     .setSrcAccessMask(vk::AccessFlagBits::eTransferWrite);
+  if (!dedicated()) {
+    cmd.pipelineBarrier(
+        vk::PipelineStageFlagBits::eTransfer,
+        vk::PipelineStageFlagBits::eAllCommands, {}, {}, {},
+        barrier.setDstAccessMask(vk::AccessFlagBits::eMemoryRead));
+    return;
+  }
+  // Both barriers perform the layout transition, which happens once. The
+  // release's destination and the acquire's source scopes are ignored: the
+  // acquire is ordered after the release by the upload timeline.
+  barrier.setSrcQueueFamilyIndex(_queueFamily)
+      .setDstQueueFamilyIndex(_graphicsFamily);
+  cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                      vk::PipelineStageFlagBits::eBottomOfPipe, {}, {}, {},
+                      barrier);
+  _acquireBarriers.push_back(barrier.setSrcAccessMask({}).setDstAccessMask(
+      vk::AccessFlagBits::eMemoryRead));
+}
+
+UploadToken UploadQueue::flush() {
+  if (!_batch) {
+    return recorded();
+  }
+  CPU_ZONE("flush uploads");
+  auto cmd = _batch->commandBuffer.get();
+  if (_gpuProfiler) {
+    _gpuProfiler->end(_batch->profile, cmd, _batch->scope);
+  }
+  cmd.end();
+  std::vector<TimelineWait> waits;
+  if (_batch->waitForFrames) {
+    waits.push_back({_graphicsTimeline->vkSemaphore(),
+                     _graphicsTimeline->submittedValue(),
+                     vk::PipelineStageFlagBits::eTransfer});
+  }
+  auto value = _timeline->submit(
+      _queue, vk::SubmitInfo{}.setCommandBuffers(cmd), waits);
+  if (_gpuProfiler) {
+    _gpuProfiler->submitted(_batch->profile, *_timeline, value);
+  }
+  _stagingRing.submitted(value);
+  _retiredUploads->retire(value, std::move(_batch->commandBuffer));
+  _batch.reset();
+
+  if (!_acquireBarriers.empty()) {
+    if (!_acquire) {
+      _acquire = std::move(_device.allocateCommandBuffersUnique(
+          vk::CommandBufferAllocateInfo{}
+              .setCommandPool(_acquireCommandPool)
+              .setCommandBufferCount(1))[0]);
+      _acquire->begin(vk::CommandBufferBeginInfo{
+          vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+    }
+    _acquire->pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe,
+                              vk::PipelineStageFlagBits::eAllCommands, {}, {},
+                              {}, _acquireBarriers);
+    _acquireBarriers.clear();
+  }
+  return {value};
+}
+
+UploadQueue::Handoff UploadQueue::handOff() {
+  auto uploads = flush();
+  if (_acquire) {
+    _acquire->end();
+  }
+  return {uploads, std::move(_acquire)};
+}
+
+UploadToken UploadQueue::recorded() const {
+  return {_batch ? _batch->value : _timeline->submittedValue()};
+}
+
+bool UploadQueue::done(UploadToken token) const {
+  return _timeline->reached(token.value);
+}
+
+void UploadQueue::wait(UploadToken token) {
+  if (_batch && token.value >= _batch->value) {
+    flush();
+  }
+  _timeline->wait(token.value);
+}
+
+vk::CommandBuffer UploadQueue::open() {
+  if (_batch) {
+    auto cmd = _batch->commandBuffer.get();
+    auto barrier =
+        vk::MemoryBarrier{}
+            .setSrcAccessMask(vk::AccessFlagBits::eTransferWrite)
+            .setDstAccessMask(vk::AccessFlagBits::eTransferRead |
+                              vk::AccessFlagBits::eTransferWrite);
+    cmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer,
+                        vk::PipelineStageFlagBits::eTransfer, {}, barrier, {},
+                        {});
+    return cmd;
+  }
+  _retiredUploads->collect(_timeline->completedValue());
+  auto commandBuffer = std::move(_device.allocateCommandBuffersUnique(
+      vk::CommandBufferAllocateInfo{}
+          .setCommandPool(_commandPool)
+          .setCommandBufferCount(1))[0]);
+  auto cmd = commandBuffer.get();
+  cmd.begin(vk::CommandBufferBeginInfo{
+      vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+  auto profile = GpuProfiler::kNoBatch;
+  auto scope = GpuProfiler::kNoScope;
+  if (_gpuProfiler) {
+    profile = _gpuProfiler->beginBatch(cmd);
+    scope = _gpuProfiler->begin(profile, cmd, "upload");
+  }
+  auto barrier = vk::MemoryBarrier{}
+                     .setSrcAccessMask(vk::AccessFlagBits::eMemoryWrite)
+                     .setDstAccessMask(vk::AccessFlagBits::eMemoryRead |
+                                       vk::AccessFlagBits::eMemoryWrite);
+  cmd.pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands,
+                      vk::PipelineStageFlagBits::eAllCommands, {}, barrier,
+                      {}, {});
+  // Only this queue signals the timeline, so the batch signals the next
+  // value.
+  _batch = Batch{std::move(commandBuffer), _timeline->submittedValue() + 1,
+                 profile, scope, false};
+  return cmd;
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <concepts>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include <vk_mem_alloc.hpp>
+#include <vulkan/vulkan.hpp>
+
+#include "gpu_profiler.hpp"
+#include "staging_ring.hpp"
+#include "upload_token.hpp"
+
+struct DeletionQueue;
+struct Timeline;
+// Collects the copies and layout transitions of uploads into a single
+// command buffer, submitted at once when flushed: loading many buffers and
+// textures costs one submission and one GPU round trip rather than one each.
+// Nothing is ever waited for unless asked to, or unless the staging ring
+// runs out of space. Graphics submissions flush the batch first (see
+// `GraphicsDevice::submitGraphics`), so frames always see the uploads
+// recorded before them.
+//
+// Batches go to a dedicated transfer queue when the device has one, so they
+// run alongside rendering, and to the graphics queue otherwise. Buffers are
+// shared by both queues' families (see `GraphicsDevice::bufferQueueFamilies`),
+// while images change hands through `releaseImage`.
+//
+// Not thread-safe.
+struct UploadQueue {
+  // What a graphics submission must do before using the uploads recorded so
+  // far: wait for `uploads`, then run `acquire`.
+  struct Handoff {
+    UploadToken uploads;
+    // Null unless images were released to the graphics queue
+    vk::UniqueCommandBuffer acquire;
+  };
+
+  // Batches are submitted to `queue`, of `queueFamily`, signalling
+  // `timeline`, which no other work may signal. Their command buffers come
+  // from `commandPool`, and are retired to `retiredUploads` along with
+  // oversized staging buffers. When `queueFamily` isn't `graphicsFamily`,
+  // images are acquired with command buffers from `acquireCommandPool`.
+  // Batches are timed by `gpuProfiler` unless null, which it must be when
+  // `queue` can't reset its queries.
+  UploadQueue(vk::Device device, vk::Queue queue, uint32_t queueFamily,
+              vk::CommandPool commandPool, uint32_t graphicsFamily,
+              vk::CommandPool acquireCommandPool, vma::Allocator allocator,
+              Timeline &timeline, const Timeline &graphicsTimeline,
+              DeletionQueue &retiredUploads, GpuProfiler *gpuProfiler);
+  UploadQueue(const UploadQueue &) = delete;
+  UploadQueue &operator=(const UploadQueue &) = delete;
+
+  // Whether batches run on a queue of their own rather than the graphics
+  // queue.
+  inline bool dedicated() const { return _queueFamily != _graphicsFamily; }
+
+  // Staging memory for the next `record`, which must copy from it. Flushes
+  // the batch first when the staging ring is full of its data.
+  StagingRing::Allocation stage(vk::DeviceSize size);
+  // Records `buildFn`'s commands into the open batch, opening one if need be.
+  // A leading barrier keeps batches from overwriting what earlier uploads
+  // still read, and transfers recorded by earlier calls complete before
+  // those of this one (e.g. two writes to the same material parameters).
+  // Commands must be supported by transfer-only queues.
+  template <std::invocable<vk::CommandBuffer> TCommandBuilder>
+  UploadToken record(TCommandBuilder buildFn) {
+    buildFn(open());
+    return {_batch->value};
+  }
+  // Makes the open batch wait for the graphics work submitted so far. To be
+  // called right after recording uploads that overwrite data frames in
+  // flight may read. On the graphics queue, the leading barrier already
+  // takes care of it.
+  void waitForFrames();
+  // Hands `image`, written in the `eTransferDstOptimal` layout by transfers
+  // recorded into `cmd`, over to graphics work in `newLayout`. With a
+  // dedicated queue this is a queue family ownership transfer: the image is
+  // released by the batch, and acquired by the next graphics submission.
+  void releaseImage(vk::CommandBuffer cmd, vk::Image image,
+                    vk::ImageSubresourceRange range,
+                    vk::ImageLayout newLayout);
+  // Submits the open batch, if any. Returns the token of everything recorded
+  // so far.
+  UploadToken flush();
+  // Flushes the batch for a graphics submission, see `Handoff`.
+  Handoff handOff();
+  // Token of everything recorded so far, flushed or not
+  UploadToken recorded() const;
+
+  // Whether the GPU is done with the upload. Never flushes, so uploads still
+  // in the open batch aren't.
+  bool done(UploadToken token) const;
+  // Blocks until the GPU is done with the upload, flushing it first if
+  // needed. Released images still need acquiring by graphics work.
+  void wait(UploadToken token);
+
+private:
+  struct Batch {
+    vk::UniqueCommandBuffer commandBuffer;
+    uint64_t value;
+    GpuProfiler::BatchId profile;
+    GpuProfiler::ScopeId scope;
+    bool waitForFrames;
+  };
+
+  // Opens a batch, or orders what is recorded next after the transfers
+  // already in the open one.
+  vk::CommandBuffer open();
+
+  vk::Device _device;
+  vk::Queue _queue;
+  uint32_t _queueFamily;
+  vk::CommandPool _commandPool;
+  uint32_t _graphicsFamily;
+  vk::CommandPool _acquireCommandPool;
+  Timeline *_timeline;
+  const Timeline *_graphicsTimeline;
+  DeletionQueue *_retiredUploads;
+  GpuProfiler *_gpuProfiler;
+  StagingRing _stagingRing;
+  std::optional<Batch> _batch;
+  // Acquire barriers of the images released by the open batch
+  std::vector<vk::ImageMemoryBarrier> _acquireBarriers;
+  // Acquires the images released by flushed batches, until the next
+  // `handOff`
+  vk::UniqueCommandBuffer _acquire;
+};
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstdint>
+
+// Identifies an upload by the upload timeline value of the batch it was
+// recorded in. The default token identifies no upload, and is always done.
+// Batches complete in order, so a token also covers the uploads recorded
+// before it.
+struct UploadToken {
+  uint64_t value = 0;
+};